@@ -4,11 +4,7 @@
 #include <unistd.h>
 #include <arpa/inet.h>
 #include <sys/socket.h>
-<<<<<<< HEAD
-#include <netinet/in.h> 
-=======
 #include <netinet/in.h>
->>>>>>> dd1395c (final commit)
 
 #define PORT 8080
 #define BUFFER_SIZE 1024
@@ -39,10 +35,6 @@ int main() {
 
     printf("Connected to Bank Server\n");
 
-<<<<<<< HEAD
-    
-=======
->>>>>>> dd1395c (final commit)
     while (1) {
         memset(buffer, 0, sizeof(buffer));
         
@@ -55,11 +47,7 @@ int main() {
         }
 
         buffer[bytes] = '\0'; 
-<<<<<<< HEAD
-        printf("%s", buffer); 
-=======
         printf("%s", buffer);
->>>>>>> dd1395c (final commit)
 
         // Check if the server's message indicates a disconnect (e.g., login failure)
         if (strstr(buffer, "Invalid login") || strstr(buffer, "deactivated")) {
@@ -69,20 +57,15 @@ int main() {
         // Get user input from stdin
         char input[BUFFER_SIZE];
         memset(input, 0, sizeof(input));
-        if (fgets(input, sizeof(input), stdin) == NULL) {
+        if (fgets(input, sizeof(input) - 1, stdin) == NULL) {
             // no input (EOF)
             break; 
         }
         
-        input[strcspn(input, "\n")] = 0;
-
-<<<<<<< HEAD
-        
-        write(sock, input, strlen(input));
-        
-=======
+        // The server reads newline-terminated lines, so keep the newline fgets stored
+        if (strchr(input, '\n') == NULL)
+            strcat(input, "\n");
         write(sock, input, strlen(input));
->>>>>>> dd1395c (final commit)
     }
 
     printf("\nDisconnected from server.\n");
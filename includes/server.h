@@ -11,16 +11,40 @@
 #include <sys/file.h>
 #include <errno.h>
 #include <time.h>
-#include <pthread.h>
+#include <sys/uio.h>
 
 #define PORT 8080
-#define MAX_CLIENTS 10
+#define DEFAULT_MAX_SESSIONS 10000
+#define DEFAULT_LOCK_STRIPES 1024
+#define DEFAULT_WORKER_THREADS 32
+#define DEFAULT_QUEUE_CAPACITY 128
+#define DEFAULT_REACTOR_THREADS 4
+#define DEFAULT_SESSION_STACK_KB 128
+#define DEFAULT_LEDGER_RING 4096
+#define DEFAULT_LEDGER_SEGMENT 262144 // transaction records per log segment
+#define DEFAULT_CHECKPOINT_SECONDS 300
+#define CLIENT_BUFFER_SIZE 4096 // per-connection input buffer
+#define OUTBUF_SIZE 4096
+#define TRANSACTION_PAGE_SIZE 20
+#define FEEDBACK_PAGE_SIZE 20
+
+// Binary protocol (see src/protocol.c)
+#define FRAME_MAGIC 0xB1
+#define FRAME_HEADER_SIZE 12
+#define FRAME_MAX_PAYLOAD 1024
 
 #define USER_FILE "users.dat"
 #define ACCOUNT_FILE "accounts.dat"
 #define LOAN_FILE "loans.dat"
-#define TRANSACTION_FILE "transactions.dat"
+#define TRANSACTION_FILE "transactions.dat" // active segment, see src/segments.c
 #define FEEDBACK_FILE "feedback.dat"
+#define SEQUENCE_FILE "sequences.dat"
+#define CHECKPOINT_FILE "checkpoint.dat"
+#define USER_INDEX_FILE "users.idx"
+#define ACCOUNT_INDEX_FILE "accounts.idx"
+#define LOAN_INDEX_FILE "loans.idx"
+
+#define SEQUENCE_MAGIC 0x31514553 // "SEQ1"
 
 // Role-based access
 typedef enum
@@ -36,7 +60,8 @@ typedef enum
     ASSIGNED = 2,         // When manager assigns to employee
     APPROVED = 3,         //  employee approves
     REJECTED = 4,         //  employee rejects
-    PROCESSING = 5       // employee is reviewing
+    PROCESSING = 5,      // employee is reviewing
+    DISBURSING = 6       // approved, deposit not yet confirmed in the log
 } LoanStatus;
 typedef enum
 {
@@ -84,21 +109,355 @@ typedef struct
     float amount;
     float oldBalance;
     float newBalance;
+    int loanID; // LOAN_DEPOSIT only; fills what was padding, so the size is unchanged
     time_t timestamp;
 } Transaction;
 
+// Bounded output buffer that streams to a socket whenever it fills
+typedef struct
+{
+    int sock;
+    size_t len;
+    char data[OUTBUF_SIZE];
+} OutBuf;
+
+// Transaction records queued for the ledger appender (see ledger_submit). An
+// entry is either one record or, from ledger_submit_batch, a caller's array of
+// records that is written contiguously. Engine commands (BANK_ENGINE=1) produce
+// their records on the appender thread.
+typedef struct
+{
+    Transaction record;
+    Transaction *records; // &record, or the batch array
+    int count;
+    struct EngineCommand *command; // applied by the engine just before writing
+    int done;   // set by the appender once the records are written
+    int result; // 0 or -1
+} LedgerEntry;
+
+// One balance change for account_apply_batch
+typedef struct
+{
+    TransactionType type; // DEPOSIT, LOAN_DEPOSIT, WITHDRAWAL or TRANSFER_SENT
+    int account_no;       // source account of a transfer
+    int to_account;       // transfers only
+    float amount;
+    int loan_id;          // LOAN_DEPOSIT only, copied to its record
+    int result;           // AccountResult
+    float balance;        // account_no's balance afterwards
+} AccountOp;
+
+typedef enum
+{
+    ENGINE_APPLY,     // ops[0..count), each with its own result
+    ENGINE_PAYOUT,    // account_bulk_transfer from account_no
+    ENGINE_SET_ACTIVE // account_set_active
+} EngineCommandType;
+
+// A command for the single-writer account engine (see src/engine.c)
+typedef struct EngineCommand
+{
+    EngineCommandType type;
+    AccountOp *ops;
+    int count;              // ops, or payouts
+    int account_no;         // payout source, or the account to (de)activate
+    const int *to_accounts; // payouts
+    const float *amounts;
+    int is_active;
+    int result;             // AccountResult of a payout or (de)activation
+    int failed_index;       // payout at fault, -1 for the source
+    Transaction inline_records[2];
+    LedgerEntry entry;
+} EngineCommand;
+
+// Fixed-size record of the old feedback.dat format, read only when converting it
 typedef struct {
     int accountID;
     char message[1034];
 } Feedback;
 
+// feedback.dat starts with FEEDBACK_MAGIC and a reserved int; each record is this
+// header followed by length message bytes (no terminator)
+#define FEEDBACK_MAGIC 0x324B4246 // "FBK2"
+#define FEEDBACK_HEADER_SIZE (2 * sizeof(int))
+#define FEEDBACK_MESSAGE_MAX 1033
+
+typedef struct
+{
+    int length; // message bytes after the header
+    int accountID;
+    time_t timestamp; // 0 for records migrated from the old format
+} FeedbackRecord;
+
+// Which feedback view_feedback_page shows
+typedef struct
+{
+    int account_no;     // 0 for every account
+    char keywords[256]; // words every message must contain, "" for any
+} FeedbackFilter;
+
+// How client sessions are scheduled
+typedef enum
+{
+    IO_THREADS = 1, // one pool worker per session (blocking sockets)
+    IO_EPOLL = 2    // sessions as coroutines on epoll reactor threads
+} IoModel;
+
+// Flush issued after each in-place update of the mapped account file
+typedef enum
+{
+    ACCOUNT_SYNC_NONE,     // leave write-back to the kernel, like plain pwrite
+    ACCOUNT_SYNC_MSYNC,    // msync(MS_SYNC) the pages holding the record
+    ACCOUNT_SYNC_FDATASYNC // fdatasync the whole account file
+} AccountSync;
+
+// How new PENDING loans reach employees (BANK_LOAN_ASSIGN)
+typedef enum
+{
+    LOAN_ASSIGN_MANUAL,     // a manager assigns every loan
+    LOAN_ASSIGN_LEAST,      // the active employee with the fewest assigned loans
+    LOAN_ASSIGN_ROUND_ROBIN // active employees in turn
+} LoanAssign;
+
+// One decision for loan_review_batch
+typedef struct
+{
+    int loan_id;
+    LoanStatus status; // APPROVED or REJECTED
+    const char *error; // why it was not applied, NULL if it was
+} LoanDecision;
+
+// Runtime configuration (environment variables, see load_server_config)
+typedef struct
+{
+    IoModel io_model;     // BANK_IO_MODEL=threads|epoll
+    int worker_threads;   // BANK_WORKERS
+    int queue_capacity;   // BANK_QUEUE_SIZE
+    int reactor_threads;  // BANK_REACTORS
+    int session_stack_kb; // BANK_SESSION_STACK_KB
+    int max_sessions;     // BANK_MAX_SESSIONS, concurrent logged-in users
+    int lock_stripes;     // BANK_LOCK_STRIPES
+    int fcntl_locks;      // BANK_FCNTL_LOCKS=1 also takes cross-process record locks
+    int account_mmap;     // BANK_ACCOUNT_MMAP=1 updates accounts in a shared mapping
+    AccountSync account_sync; // BANK_ACCOUNT_SYNC=none|msync|fdatasync
+    int ledger_ring;      // BANK_LEDGER_RING, queued transaction records
+    int ledger_sync;      // BANK_LEDGER_SYNC=1 fdatasyncs each appended batch
+    int ledger_segment;   // BANK_LEDGER_SEGMENT, records before the log rotates
+    int engine;           // BANK_ENGINE=1 applies balance changes on one thread
+    int engine_cpu;       // BANK_ENGINE_CPU pins that thread, -1 = not pinned
+    int checkpoint_seconds; // BANK_CHECKPOINT_SECONDS between checkpoints, 0 = never
+    LoanAssign loan_assign; // BANK_LOAN_ASSIGN=manual|least|round-robin
+} ServerConfig;
+
+// Snapshot of the connection worker pool
+typedef struct
+{
+    int workers;
+    int busy_workers;
+    int queue_depth;
+    int queue_capacity;
+    int peak_queue_depth;
+    long served;
+    long full_waits;    // submits that found the queue full
+    double utilization; // busy worker-seconds / (uptime * workers)
+} PoolStats;
+
+// Results of claim_login
+typedef enum
+{
+    LOGIN_OK = 0,
+    LOGIN_DUPLICATE = -1, // user already has a live session
+    LOGIN_FULL = -2       // BANK_MAX_SESSIONS reached
+} LoginClaim;
+
+// Results of the account_* operations
+typedef enum
+{
+    ACC_OK = 0,
+    ACC_NOT_FOUND = -1,
+    ACC_INACTIVE = -2,
+    ACC_INSUFFICIENT = -3,
+    ACC_INVALID = -4, // non-positive amount, or transfer to the same account
+    ACC_EXISTS = -5,
+    ACC_IO_ERROR = -6
+} AccountResult;
+
+// Binary protocol opcodes
+typedef enum
+{
+    FRAME_LOGIN = 1,
+    FRAME_BALANCE = 2,
+    FRAME_DEPOSIT = 3,
+    FRAME_WITHDRAW = 4,
+    FRAME_TRANSFER = 5,
+    FRAME_LOGOUT = 6
+} FrameOp;
+
+// Frame status: FRAME_OK, an AccountResult, or one of these
+typedef enum
+{
+    FRAME_OK = 0,
+    FRAME_BAD_REQUEST = -10,
+    FRAME_NOT_LOGGED_IN = -11,
+    FRAME_LOGIN_FAILED = -12,
+    FRAME_LOGIN_BUSY = -13 // already logged in elsewhere, or server full
+} FrameStatus;
+
+// Snapshot of the epoll session engine
+typedef struct
+{
+    int reactors;
+    long active_sessions;
+    long total_sessions;
+} ReactorStats;
+
+typedef struct Session Session;
+typedef struct Reactor Reactor;
+
+// Min/max values of the records in one transaction log segment
+typedef struct
+{
+    long min_id;
+    long max_id;
+    time_t min_time;
+    time_t max_time;
+    int min_account;
+    int max_account;
+} ZoneMap;
+
+typedef struct
+{
+    long base;  // record number of the segment's first record
+    long count;
+    int sealed; // full, footer written and read-only
+    ZoneMap zone;
+} SegmentInfo;
+
+// Data files kept open for the life of the server
+typedef enum
+{
+    DATA_USERS,
+    DATA_ACCOUNTS,
+    DATA_LOANS,
+    DATA_FEEDBACK,
+    DATA_FILE_COUNT
+} DataFile;
+
+// Persistent next-ID counters, one per data file
+typedef enum
+{
+    SEQ_USER,
+    SEQ_ACCOUNT,
+    SEQ_LOAN,
+    SEQ_TRANSACTION,
+    SEQ_COUNT
+} SequenceType;
+
+typedef struct
+{
+    int magic;
+    long next[SEQ_COUNT];
+} SequenceHeader;
+
+// Persistent B+tree from a record's ID to its offset in a data file, kept in its
+// own mapped index file (see src/btree.c)
+typedef struct
+{
+    pthread_rwlock_t lock;
+    const char *path;
+    DataFile file;
+    size_t record_size;
+    int fd;
+    char *pages;     // mapping of the index file, page 0 is its header
+    long mapped_len; // bytes of the mapping backed by the file
+    int count;       // keys
+    int ready;       // set once the index is open and up to date
+    int journal_fd;  // pre-images of synced pages changed since the last sync
+    long journal_len;
+    int synced_pages;         // pages of the tree as last synced
+    unsigned char *journaled; // per synced page, set once it is in the journal
+    int unsynced;             // inserts since the last sync
+} OffsetIndex;
+
+// Per-account list of transaction record numbers (positions in the segmented log)
+typedef struct
+{
+    int account_no;
+    long *records; // NULL marks an empty slot
+    int count;
+    int capacity;
+} PostingList;
+
+typedef struct
+{
+    pthread_rwlock_t lock;
+    PostingList *lists;
+    int capacity;
+    int count;
+    int ready;
+} PostingIndex;
+
 // Globals
-extern pthread_spinlock_t login_lock;
-extern int logged_in_users[MAX_CLIENTS];
+extern OffsetIndex user_index;
+extern OffsetIndex account_index;
+extern OffsetIndex loan_index;
+extern PostingIndex transaction_index;
+extern ServerConfig server_config;
+
+// Configuration
+void load_server_config();
+
+// Worker pool
+void thread_pool_start(int worker_count, int capacity);
+void thread_pool_submit(int sock);
+void thread_pool_stats(PoolStats *stats);
+
+// Event-driven session engine
+void reactor_start(int count);
+void reactor_add(int sock);
+int session_wait(int sock, int events);
+void reactor_stats(ReactorStats *stats);
+
+// Logged-in user registry
+void init_session_registry(int capacity);
+int claim_login(int userID);
+void release_login(int userID);
+int active_login_count();
+int login_capacity();
 
 // Utilities
+void init_client_buffers();
+void reset_client_buffer(int sock);
 int read_from_client(int sock, char *buffer, int size);
+int read_client_bytes(int sock, void *dest, int count);
+int peek_client_byte(int sock);
+int client_buffered(int sock);
+int client_line_ready(int sock);
+void write_client_bytes(int sock, const void *data, size_t len);
 void write_to_client(int sock, const char *message);
+void outbuf_init(OutBuf *out, int sock);
+void outbuf_printf(OutBuf *out, const char *format, ...);
+void outbuf_flush(OutBuf *out);
+
+// Binary protocol
+void frame_session(int sock);
+
+// Batch commands
+void batch_session(int sock);
+
+// Shared data file handles
+void open_data_files();
+int data_fd(DataFile file);
+long data_file_size(DataFile file);
+long data_append(DataFile file, const void *record, size_t size);
+long data_append_new(DataFile file, void *record, size_t size, SequenceType type);
+void data_truncate(DataFile file, long size);
+void data_reopen(DataFile file);
+
+// Memory-mapped account store
+void init_account_store();
+Account *account_store_record(long offset);
+int account_store_flush(Account *record);
 
 // File helpers
 long find_user_offset(int fd, int userID);
@@ -107,23 +466,104 @@ long find_loan_offset(int fd, int loan_id);
 int get_next_user_id(int fd);
 int get_next_account_no(int fd);
 long get_next_loan_id(int fd);
-long get_next_transaction_id(int fd);
 void initialize_admin();
+int user_create(const char *name, const char *password, Role role);
+
+// Indexes
+void index_open(OffsetIndex *index, const char *path, DataFile file, size_t record_size);
+long index_lookup(OffsetIndex *index, int id);
+void index_insert(OffsetIndex *index, int id, long offset);
+int index_range(OffsetIndex *index, int from, int to, int *ids, long *offsets, int max);
+long index_max_id(OffsetIndex *index);
+void posting_init(PostingIndex *index);
+void posting_append(PostingIndex *index, int account_no, long record_no);
+void posting_extend(PostingIndex *index, int account_no, const long *records, int count);
+int posting_count(PostingIndex *index, int account_no);
+int posting_range(PostingIndex *index, int account_no, int from, int count, long *records);
+void build_indexes();
+
+// Sequences
+void init_sequences();
+long next_sequence_id(SequenceType type);
+long reserve_sequence_ids(SequenceType type, int count);
+
+// Checkpoints and log replay
+long load_checkpoint();
+void replay_log(long record_no);
+void start_checkpoints(int seconds);
+
+// Account locks
+void init_lock_manager(int stripes, int use_fcntl);
+void lock_account(int account_no, int exclusive);
+void unlock_account(int account_no);
+void lock_accounts(const int *account_nos, int count);
+void unlock_accounts(const int *account_nos, int count);
+void lock_account_appends();
+void unlock_account_appends(long locked_from);
+
+// Account operations
+int account_get(int account_no, Account *acc);
+int account_deposit(int account_no, float amount, TransactionType type, float *new_balance);
+int account_withdraw(int account_no, float amount, float *new_balance);
+int account_transfer(int from_account, int to_account, float amount);
+int account_set_active(int account_no, int is_active);
+int account_create(int account_no, float balance);
+int account_apply_batch(AccountOp *ops, int count);
+int account_bulk_transfer(int from_account, const int *to_accounts, const float *amounts, int count, int *failed_index);
+
+// Segmented transaction log
+void init_segments(int records_per_segment);
+long segments_append(const struct iovec *iov, int count);
+int segments_sync();
+long segments_record_count();
+int segments_read(long record_no, Transaction *records, int count);
+int segments_info(int index, SegmentInfo *info);
+long segments_last_id();
+int zone_map_matches(const ZoneMap *zone, int account_no, time_t from, time_t to);
+void segment_postings_name(char *name, size_t size, long base);
+
+// Transaction log appender
+void init_ledger(int capacity);
+void ledger_submit(LedgerEntry *entry, int accountID, TransactionType type, float amount, float oldBalance, float newBalance);
+void ledger_submit_batch(LedgerEntry *entry, Transaction *records, int count);
+void ledger_submit_command(LedgerEntry *entry, struct EngineCommand *command, Transaction *records);
+int ledger_wait(LedgerEntry *entry);
+long ledger_published_records();
+
+// Single-writer account engine
+void init_engine();
+int engine_execute(EngineCommand *cmd);
+void engine_apply(EngineCommand *cmd);
+void engine_publish();
+void engine_rollback();
+int engine_read(long offset, Account *acc);
 
 // Transactions
 void log_transaction(int accountID, TransactionType type, float amount, float oldBalance, float newBalance);
-void view_transactions(int sock, int account_no);
+long view_transactions(int sock, int account_no, int page_size, long cursor, int newest_first);
+void browse_transactions(int sock, int account_no);
+void view_transactions_between(int sock, int account_no, time_t from, time_t to);
+void browse_transactions_by_date(int sock);
 int transfer_funds(int sock, int from_account, int to_account, float amount);
 
 // Feedback
+void init_feedback();
+int migrate_feedback_file(const char *path);
 void give_feedback(int accountID, const char *message);
+long view_feedback_page(int sock, const FeedbackFilter *filter, int page_size, long cursor);
 void view_feedbacks(int sock);
 
 // Loans
+void init_loan_queues();
+void init_loan_assignment();
+void auto_assign_loans();
+void loan_roster_update(int employee_id, int eligible);
 void view_pending_loans(int sock);
 void assign_loan(int sock);
+int loan_review_batch(int emp_id, LoanDecision *decisions, int count);
 void employee_process_loan(int sock, User emp_user);
 void customer_apply_loan(int sock, User user);
+int loan_create(int customer_id, float amount);
 
 // Reusable functions & menus
 int reusable_add_user(int sock, Role adder_role);
@@ -131,6 +571,7 @@ void reusable_add_bank_account(int sock, int new_account_no);
 void reusable_modify_user(int sock, Role modifier_role, int target_userID);
 void reusable_activate_deactivate_user(int sock, int choice);
 void reusable_activate_deactivate_account(int sock, int choice);
+void view_server_status(int sock);
 
 void admin_menu(int sock, User admin_user);
 void manager_menu(int sock, User mgr_user);
@@ -138,6 +579,6 @@ void employee_menu(int sock, User emp_user);
 void customer_menu(int sock, User user, Account account);
 
 // Client handler and main
-void *handle_client(void *sock_ptr);
+void handle_client(int new_socket);
 
 #endif // SERVER_H
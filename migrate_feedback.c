@@ -0,0 +1,13 @@
+#include "includes/server.h"
+
+// Converts a feedback file from the old fixed-size format to the one read by the
+// server (src/feedback_migrate.c). The server also converts feedback.dat itself
+// at startup; this does it ahead of time, with the server stopped. The original
+// is kept as <file>.old.
+//
+//   ./migrate_feedback [feedback.dat]
+
+int main(int argc, char *argv[])
+{
+    return migrate_feedback_file(argc > 1 ? argv[1] : FEEDBACK_FILE) < 0 ? 1 : 0;
+}
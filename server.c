@@ -1,105 +1,84 @@
 // Minimal server main and handler that use modularized implementation files.
 #include <pthread.h>
+#include <signal.h>
 #include "includes/server.h"
 
-// Globals for login management
-pthread_spinlock_t login_lock;
-int logged_in_users[MAX_CLIENTS];
-
-void *handle_client(void *sock_ptr)
+// Runs one session to completion, on a pool worker or as a reactor coroutine
+void handle_client(int new_socket)
 {
-    int new_socket = *((int *)sock_ptr);
-    free(sock_ptr);
-
     char buffer[1024], pass[64];
     int user_id;
-    int logged_in_slot = -1;
 
-    int user_fd = open(USER_FILE, O_RDONLY);
-    if (user_fd < 0)
+    reset_client_buffer(new_socket);
+    write_to_client(new_socket, "Welcome to Bank\n");
+    write_to_client(new_socket, "Enter UserID: ");
+
+    // Binary clients answer the prompt with a frame instead of a line
+    if (peek_client_byte(new_socket) == FRAME_MAGIC)
     {
-        write_to_client(new_socket, "Server error: Cannot open user file.\n");
+        frame_session(new_socket);
         close(new_socket);
-        pthread_exit(NULL);
+        return;
     }
 
-    write_to_client(new_socket, "Welcome to Bank\n");
-    write_to_client(new_socket, "Enter UserID: ");
     if (read_from_client(new_socket, buffer, sizeof(buffer)) <= 0)
     {
-        close(user_fd);
         close(new_socket);
-        pthread_exit(NULL);
+        return;
     }
     user_id = atoi(buffer);
 
     write_to_client(new_socket, "Enter password: ");
     if (read_from_client(new_socket, pass, sizeof(pass)) <= 0)
     {
-        close(user_fd);
         close(new_socket);
-        pthread_exit(NULL);
+        return;
     }
 
+    int user_fd = data_fd(DATA_USERS);
     long user_offset = find_user_offset(user_fd, user_id);
     if (user_offset == -1)
     {
         write_to_client(new_socket, "Invalid login: User not found.\n");
-        close(user_fd);
         close(new_socket);
-        pthread_exit(NULL);
+        return;
     }
 
     User user;
-    lseek(user_fd, user_offset, SEEK_SET);
-    read(user_fd, &user, sizeof(User));
+    if (pread(user_fd, &user, sizeof(User), user_offset) != sizeof(User))
+    {
+        write_to_client(new_socket, "Server error: Cannot read user file.\n");
+        close(new_socket);
+        return;
+    }
 
     if (strcmp(user.password, pass) != 0)
     {
         write_to_client(new_socket, "Invalid login: Incorrect password.\n");
-        close(user_fd);
         close(new_socket);
-        pthread_exit(NULL);
+        return;
     }
 
     if (!user.is_active)
     {
         write_to_client(new_socket, "Login failed: User login is deactivated.\n");
-        close(user_fd);
         close(new_socket);
-        pthread_exit(NULL);
+        return;
     }
 
-    // Login slot management
-    pthread_spin_lock(&login_lock);
-    for (int i = 0; i < MAX_CLIENTS; i++)
+    // One session per user
+    int claim = claim_login(user.userID);
+    if (claim == LOGIN_DUPLICATE)
     {
-        if (logged_in_users[i] == user.userID)
-        {
-            pthread_spin_unlock(&login_lock);
-            write_to_client(new_socket, "Login failed: This user is already logged in elsewhere.\n");
-            close(user_fd);
-            close(new_socket);
-            pthread_exit(NULL);
-        }
-    }
-    for (int i = 0; i < MAX_CLIENTS; i++)
-    {
-        if (logged_in_users[i] == -1)
-        {
-            logged_in_users[i] = user.userID;
-            logged_in_slot = i;
-            break;
-        }
+        write_to_client(new_socket, "Login failed: This user is already logged in elsewhere.\n");
+        close(new_socket);
+        return;
     }
-    pthread_spin_unlock(&login_lock);
-
-    if (logged_in_slot == -1)
+    if (claim == LOGIN_FULL)
     {
         write_to_client(new_socket, "Login failed: Server is full. Please try again later.\n");
-        close(user_fd);
         close(new_socket);
-        pthread_exit(NULL);
+        return;
     }
 
     write_to_client(new_socket, "Login successful!\n");
@@ -112,38 +91,20 @@ void *handle_client(void *sock_ptr)
         employee_menu(new_socket, user);
     else if (user.role == CUSTOMER)
     {
-        int acc_fd = open(ACCOUNT_FILE, O_RDONLY);
-        if (acc_fd < 0)
-        {
+        Account account;
+        int result = account_get(user.userID, &account);
+        if (result == ACC_NOT_FOUND)
+            write_to_client(new_socket, "Error: You are a customer but have no bank account.\n");
+        else if (result != ACC_OK)
             write_to_client(new_socket, "Error: Could not open bank account file.\n");
-        }
         else
-        {
-            long acc_offset = find_account_offset(acc_fd, user.userID);
-            if (acc_offset == -1)
-            {
-                write_to_client(new_socket, "Error: You are a customer but have no bank account.\n");
-            }
-            else
-            {
-                Account account;
-                lseek(acc_fd, acc_offset, SEEK_SET);
-                read(acc_fd, &account, sizeof(Account));
-                customer_menu(new_socket, user, account);
-            }
-            close(acc_fd);
-        }
+            customer_menu(new_socket, user, account);
     }
 
     // Logout
-    pthread_spin_lock(&login_lock);
-    if (logged_in_users[logged_in_slot] == user.userID)
-        logged_in_users[logged_in_slot] = -1;
-    pthread_spin_unlock(&login_lock);
+    release_login(user.userID);
 
-    close(user_fd);
     close(new_socket);
-    pthread_exit(NULL);
 }
 
 int main()
@@ -152,7 +113,22 @@ int main()
     struct sockaddr_in address;
     socklen_t addrlen = sizeof(address);
 
+    load_server_config();
+    init_client_buffers();
+    open_data_files();
+    init_feedback();
+    init_segments(server_config.ledger_segment);
     initialize_admin();
+    build_indexes();
+    init_sequences();
+    init_loan_queues();
+    init_loan_assignment();
+    init_lock_manager(server_config.lock_stripes, server_config.fcntl_locks);
+    init_account_store();
+    if (server_config.engine)
+        init_engine();
+    init_ledger(server_config.ledger_ring);
+    start_checkpoints(server_config.checkpoint_seconds);
 
     server_fd = socket(AF_INET, SOCK_STREAM, 0);
     if (server_fd < 0)
@@ -174,17 +150,28 @@ int main()
         exit(EXIT_FAILURE);
     }
 
-    if (listen(server_fd, MAX_CLIENTS) < 0)
+    if (listen(server_fd, server_config.queue_capacity) < 0)
     {
         perror("listen failed");
         exit(EXIT_FAILURE);
     }
 
-    pthread_spin_init(&login_lock, 0);
-    for (int i = 0; i < MAX_CLIENTS; i++)
-        logged_in_users[i] = -1;
+    init_session_registry(server_config.max_sessions);
 
-    printf("Bank Server started. Waiting for clients on port %d...\n", PORT);
+    // A client hanging up mid-write must fail that write, not kill the process
+    signal(SIGPIPE, SIG_IGN);
+    if (server_config.io_model == IO_EPOLL)
+    {
+        reactor_start(server_config.reactor_threads);
+        printf("Bank Server started with %d epoll reactors. Waiting for clients on port %d...\n",
+               server_config.reactor_threads, PORT);
+    }
+    else
+    {
+        thread_pool_start(server_config.worker_threads, server_config.queue_capacity);
+        printf("Bank Server started with %d workers. Waiting for clients on port %d...\n",
+               server_config.worker_threads, PORT);
+    }
 
     while (1)
     {
@@ -195,17 +182,10 @@ int main()
             continue;
         }
 
-        int *sock_ptr = malloc(sizeof(int));
-        *sock_ptr = new_socket;
-        pthread_t tid;
-        if (pthread_create(&tid, NULL, handle_client, sock_ptr) != 0)
-        {
-            perror("pthread_create failed");
-            free(sock_ptr);
-            close(new_socket);
-            continue;
-        }
-        pthread_detach(tid);
+        if (server_config.io_model == IO_EPOLL)
+            reactor_add(new_socket);
+        else
+            thread_pool_submit(new_socket);
     }
 
     close(server_fd);
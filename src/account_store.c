@@ -0,0 +1,85 @@
+#include "../includes/server.h"
+#include <stdint.h>
+#include <sys/mman.h>
+
+// Optional memory-mapped view of ACCOUNT_FILE (BANK_ACCOUNT_MMAP=1). A large
+// address range is reserved once at startup and the file is mapped into it chunk
+// by chunk as it grows, so record pointers stay valid for the life of the server.
+// Balance reads are plain loads and updates are stores into the page cache,
+// followed by the flush selected with BANK_ACCOUNT_SYNC.
+
+#define ACCOUNT_MAP_RESERVE (1L << 30) // address space reserved for the mapping
+#define ACCOUNT_MAP_CHUNK (1L << 20)   // the mapping grows this much at a time
+
+static char *map_base;
+static long mapped_len; // bytes of the reserved range backed by the file
+static pthread_mutex_t grow_lock = PTHREAD_MUTEX_INITIALIZER;
+static long page_size;
+
+// Maps whole chunks until the mapping covers the first needed bytes of the file
+static int extend_mapping(long needed)
+{
+    pthread_mutex_lock(&grow_lock);
+    long len = mapped_len;
+    while (len < needed && len < ACCOUNT_MAP_RESERVE)
+    {
+        // Chunks may run past EOF; only records below data_file_size are touched
+        if (mmap(map_base + len, ACCOUNT_MAP_CHUNK, PROT_READ | PROT_WRITE,
+                 MAP_SHARED | MAP_FIXED, data_fd(DATA_ACCOUNTS), len) == MAP_FAILED)
+        {
+            perror("Failed to extend account mapping");
+            break;
+        }
+        len += ACCOUNT_MAP_CHUNK;
+    }
+    __atomic_store_n(&mapped_len, len, __ATOMIC_RELEASE);
+    pthread_mutex_unlock(&grow_lock);
+    return len >= needed ? 0 : -1;
+}
+
+void init_account_store()
+{
+    if (!server_config.account_mmap)
+        return;
+
+    page_size = sysconf(_SC_PAGESIZE);
+    void *base = mmap(NULL, ACCOUNT_MAP_RESERVE, PROT_NONE,
+                      MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (base == MAP_FAILED)
+    {
+        perror("Failed to reserve account mapping, using pread/pwrite");
+        server_config.account_mmap = 0;
+        return;
+    }
+    map_base = base;
+    extend_mapping(data_file_size(DATA_ACCOUNTS));
+}
+
+// Returns the mapped record at offset, or NULL when the store is not mapped
+Account *account_store_record(long offset)
+{
+    if (map_base == NULL)
+        return NULL;
+
+    long end = offset + (long)sizeof(Account);
+    if (end > data_file_size(DATA_ACCOUNTS))
+        return NULL;
+    if (end > __atomic_load_n(&mapped_len, __ATOMIC_ACQUIRE) && extend_mapping(end) != 0)
+        return NULL;
+    return (Account *)(map_base + offset);
+}
+
+// Makes an in-place update durable according to BANK_ACCOUNT_SYNC
+int account_store_flush(Account *record)
+{
+    if (server_config.account_sync == ACCOUNT_SYNC_MSYNC)
+    {
+        // msync wants page-aligned ranges; a record may straddle two pages
+        uintptr_t start = (uintptr_t)record & ~(uintptr_t)(page_size - 1);
+        uintptr_t end = (uintptr_t)(record + 1);
+        return msync((void *)start, end - start, MS_SYNC) == 0 ? ACC_OK : ACC_IO_ERROR;
+    }
+    if (server_config.account_sync == ACCOUNT_SYNC_FDATASYNC)
+        return fdatasync(data_fd(DATA_ACCOUNTS)) == 0 ? ACC_OK : ACC_IO_ERROR;
+    return ACC_OK;
+}
@@ -0,0 +1,461 @@
+#include "../includes/server.h"
+
+// Account record operations shared by the menus, transfers and loan processing.
+// Each one takes its account locks only after all client input has been read, so a
+// lock is never held while a session waits on the network. Ledger records are
+// queued under the locks but waited for after releasing them. With BANK_ENGINE=1
+// balance changes and (de)activations go to the single-writer engine instead and
+// take no account locks (src/engine.c).
+
+static int read_account(int fd, long offset, Account *acc)
+{
+    Account *mapped = account_store_record(offset);
+    if (mapped != NULL)
+    {
+        *acc = *mapped;
+        return ACC_OK;
+    }
+    return pread(fd, acc, sizeof(Account), offset) == sizeof(Account) ? ACC_OK : ACC_IO_ERROR;
+}
+
+// With BANK_ACCOUNT_MMAP the record is updated in place and flushed per BANK_ACCOUNT_SYNC
+static int write_account(int fd, long offset, const Account *acc)
+{
+    Account *mapped = account_store_record(offset);
+    if (mapped != NULL)
+    {
+        *mapped = *acc;
+        return account_store_flush(mapped);
+    }
+    return pwrite(fd, acc, sizeof(Account), offset) == sizeof(Account) ? ACC_OK : ACC_IO_ERROR;
+}
+
+int account_get(int account_no, Account *acc)
+{
+    int fd = data_fd(DATA_ACCOUNTS);
+
+    int result = ACC_NOT_FOUND;
+    long offset = find_account_offset(fd, account_no);
+    if (offset != -1 && server_config.engine && engine_read(offset, acc) == ACC_OK)
+        return ACC_OK;
+    if (offset != -1)
+    {
+        lock_account(account_no, 0);
+        result = read_account(fd, offset, acc);
+        unlock_account(account_no);
+    }
+    return result;
+}
+
+static void add_record(Transaction *records, int *count, int accountID, TransactionType type, float amount,
+                       float oldBalance, float newBalance)
+{
+    Transaction *t = &records[(*count)++];
+    memset(t, 0, sizeof(*t));
+    t->accountID = accountID;
+    t->type = type;
+    t->amount = amount;
+    t->oldBalance = oldBalance;
+    t->newBalance = newBalance;
+}
+
+// Applies one operation whose accounts are already locked and looked up; every
+// account it touches must be active. Adds its ledger records (at most two) to
+// records. The caller queues them as one batch before unlocking and waits for
+// them afterwards.
+static void apply_locked(int fd, AccountOp *op, long offset, long to_offset, Transaction *records, int *record_count)
+{
+    Account acc, to_acc;
+    op->result = read_account(fd, offset, &acc);
+    if (op->result == ACC_OK && !acc.is_active)
+        op->result = ACC_INACTIVE;
+    if (op->result != ACC_OK)
+        return;
+
+    float old_bal = acc.balance;
+    if (op->type == DEPOSIT || op->type == LOAN_DEPOSIT)
+    {
+        acc.balance += op->amount;
+        op->result = write_account(fd, offset, &acc);
+        if (op->result == ACC_OK)
+        {
+            add_record(records, record_count, op->account_no, op->type, op->amount, old_bal, acc.balance);
+            records[*record_count - 1].loanID = op->loan_id;
+        }
+    }
+    else if (op->type == WITHDRAWAL)
+    {
+        if (acc.balance < op->amount)
+        {
+            op->result = ACC_INSUFFICIENT;
+            return;
+        }
+        acc.balance -= op->amount;
+        op->result = write_account(fd, offset, &acc);
+        if (op->result == ACC_OK)
+            add_record(records, record_count, op->account_no, WITHDRAWAL, op->amount, old_bal, acc.balance);
+    }
+    else
+    {
+        op->result = read_account(fd, to_offset, &to_acc);
+        if (op->result == ACC_OK && !to_acc.is_active)
+            op->result = ACC_INACTIVE;
+        if (op->result == ACC_OK && acc.balance < op->amount)
+            op->result = ACC_INSUFFICIENT;
+        if (op->result != ACC_OK)
+            return;
+
+        float to_old_bal = to_acc.balance;
+        acc.balance -= op->amount;
+        to_acc.balance += op->amount;
+        op->result = write_account(fd, offset, &acc);
+        if (op->result == ACC_OK)
+            op->result = write_account(fd, to_offset, &to_acc);
+        if (op->result == ACC_OK)
+        {
+            add_record(records, record_count, op->account_no, TRANSFER_SENT, op->amount, old_bal, acc.balance);
+            add_record(records, record_count, op->to_account, TRANSFER_RECEIVED, op->amount, to_old_bal, to_acc.balance);
+        }
+    }
+    op->balance = acc.balance;
+}
+
+// Validates an operation; returns ACC_OK and its record offsets when it can run
+static int prepare_op(int fd, AccountOp *op, long *offset, long *to_offset)
+{
+    int is_transfer = (op->type == TRANSFER_SENT);
+    if (op->amount <= 0 || (is_transfer && op->account_no == op->to_account))
+        return ACC_INVALID;
+
+    *offset = find_account_offset(fd, op->account_no);
+    *to_offset = is_transfer ? find_account_offset(fd, op->to_account) : 0;
+    if (*offset == -1 || *to_offset == -1)
+        return ACC_NOT_FOUND;
+    return ACC_OK;
+}
+
+static int run_op(AccountOp *op)
+{
+    int fd = data_fd(DATA_ACCOUNTS);
+    long offset, to_offset;
+    op->result = prepare_op(fd, op, &offset, &to_offset);
+    if (op->result != ACC_OK)
+        return op->result;
+
+    if (server_config.engine)
+    {
+        EngineCommand cmd = {.type = ENGINE_APPLY, .ops = op, .count = 1};
+        engine_execute(&cmd);
+        return op->result;
+    }
+
+    int accounts[2] = {op->account_no, op->to_account};
+    int count = (op->type == TRANSFER_SENT) ? 2 : 1;
+    Transaction records[2];
+    int record_count = 0;
+    LedgerEntry entry;
+    lock_accounts(accounts, count);
+    apply_locked(fd, op, offset, to_offset, records, &record_count);
+    if (record_count > 0)
+        ledger_submit_batch(&entry, records, record_count);
+    unlock_accounts(accounts, count);
+
+    // The account is already written back; report that the log did not take it
+    if (record_count > 0 && ledger_wait(&entry) < 0)
+        op->result = ACC_IO_ERROR;
+    return op->result;
+}
+
+// Adds amount and logs it as type (DEPOSIT or LOAN_DEPOSIT)
+int account_deposit(int account_no, float amount, TransactionType type, float *new_balance)
+{
+    AccountOp op = {.type = type, .account_no = account_no, .amount = amount};
+    int result = run_op(&op);
+    if (result == ACC_OK && new_balance)
+        *new_balance = op.balance;
+    return result;
+}
+
+int account_withdraw(int account_no, float amount, float *new_balance)
+{
+    AccountOp op = {.type = WITHDRAWAL, .account_no = account_no, .amount = amount};
+    int result = run_op(&op);
+    if (result == ACC_OK && new_balance)
+        *new_balance = op.balance;
+    return result;
+}
+
+int account_transfer(int from_account, int to_account, float amount)
+{
+    AccountOp op = {.type = TRANSFER_SENT, .account_no = from_account, .to_account = to_account, .amount = amount};
+    return run_op(&op);
+}
+
+// Runs a batch of operations under one acquisition of all their account locks.
+// Operations apply in array order and each gets its own result, so one failure
+// does not affect the rest. The ledger records of the whole batch are appended by
+// a single write. Returns the number that succeeded.
+int account_apply_batch(AccountOp *ops, int count)
+{
+    int fd = data_fd(DATA_ACCOUNTS);
+    long *offsets = malloc(sizeof(long) * count * 2);
+    int *accounts = malloc(sizeof(int) * count * 2);
+    int locked = 0;
+
+    for (int i = 0; i < count; i++)
+    {
+        ops[i].result = prepare_op(fd, &ops[i], &offsets[2 * i], &offsets[2 * i + 1]);
+        if (ops[i].result != ACC_OK)
+            continue;
+        accounts[locked++] = ops[i].account_no;
+        if (ops[i].type == TRANSFER_SENT)
+            accounts[locked++] = ops[i].to_account;
+    }
+
+    if (locked > 0 && server_config.engine)
+    {
+        EngineCommand cmd = {.type = ENGINE_APPLY, .ops = ops, .count = count};
+        engine_execute(&cmd);
+    }
+    else if (locked > 0)
+    {
+        Transaction *records = malloc(sizeof(Transaction) * locked);
+        int record_count = 0;
+        LedgerEntry entry;
+        lock_accounts(accounts, locked);
+        for (int i = 0; i < count; i++)
+            if (ops[i].result == ACC_OK)
+                apply_locked(fd, &ops[i], offsets[2 * i], offsets[2 * i + 1], records, &record_count);
+        if (record_count > 0)
+            ledger_submit_batch(&entry, records, record_count);
+        unlock_accounts(accounts, locked);
+
+        if (record_count > 0 && ledger_wait(&entry) < 0)
+        {
+            for (int i = 0; i < count; i++)
+                if (ops[i].result == ACC_OK)
+                    ops[i].result = ACC_IO_ERROR;
+        }
+        free(records);
+    }
+
+    int succeeded = 0;
+    for (int i = 0; i < count; i++)
+        if (ops[i].result == ACC_OK)
+            succeeded++;
+    free(offsets);
+    free(accounts);
+    return succeeded;
+}
+
+typedef struct
+{
+    int account_no;
+    int first; // index of the first payout to this account
+} PayoutTarget;
+
+static int compare_targets(const void *a, const void *b)
+{
+    const PayoutTarget *x = a, *y = b;
+    if (x->account_no != y->account_no)
+        return (x->account_no > y->account_no) - (x->account_no < y->account_no);
+    return x->first - y->first;
+}
+
+// Moves amounts[i] from from_account to each to_accounts[i], all or nothing. Every
+// account is locked once, every record is checked before any is written, and the
+// 2 * count ledger records are appended by a single write. On failure returns the
+// AccountResult and sets *failed_index to the offending payout (-1 for the source).
+int account_bulk_transfer(int from_account, const int *to_accounts, const float *amounts, int count, int *failed_index)
+{
+    int fd = data_fd(DATA_ACCOUNTS);
+    *failed_index = -1;
+    if (count <= 0)
+        return ACC_INVALID;
+    if (server_config.engine)
+    {
+        EngineCommand cmd = {.type = ENGINE_PAYOUT, .count = count, .account_no = from_account,
+                             .to_accounts = to_accounts, .amounts = amounts};
+        engine_execute(&cmd);
+        *failed_index = cmd.failed_index;
+        return cmd.result;
+    }
+
+    long from_offset = find_account_offset(fd, from_account);
+    if (from_offset == -1)
+        return ACC_NOT_FOUND;
+
+    // Distinct destinations, sorted so repeats share one record
+    PayoutTarget *targets = malloc(sizeof(PayoutTarget) * count);
+    for (int i = 0; i < count; i++)
+    {
+        if (amounts[i] <= 0 || to_accounts[i] == from_account)
+        {
+            *failed_index = i;
+            free(targets);
+            return ACC_INVALID;
+        }
+        targets[i].account_no = to_accounts[i];
+        targets[i].first = i;
+    }
+    qsort(targets, count, sizeof(PayoutTarget), compare_targets);
+
+    int unique = 0;
+    for (int i = 0; i < count; i++)
+        if (i == 0 || targets[i].account_no != targets[i - 1].account_no)
+            targets[unique++] = targets[i];
+
+    int *slot_of = malloc(sizeof(int) * count);
+    long *offsets = malloc(sizeof(long) * unique);
+    Account *accounts = malloc(sizeof(Account) * unique);
+    Account *before = malloc(sizeof(Account) * unique);
+    int *locked = malloc(sizeof(int) * (unique + 1));
+    Transaction *records = calloc(2 * count, sizeof(Transaction));
+
+    int result = ACC_OK;
+    for (int t = 0; t < unique && result == ACC_OK; t++)
+    {
+        offsets[t] = find_account_offset(fd, targets[t].account_no);
+        if (offsets[t] == -1)
+        {
+            result = ACC_NOT_FOUND;
+            *failed_index = targets[t].first;
+        }
+        locked[t] = targets[t].account_no;
+    }
+    locked[unique] = from_account;
+
+    if (result == ACC_OK)
+    {
+        for (int i = 0; i < count; i++)
+        {
+            PayoutTarget key = {to_accounts[i], 0};
+            int lo = 0, hi = unique - 1;
+            while (lo < hi)
+            {
+                int mid = (lo + hi) / 2;
+                if (targets[mid].account_no < key.account_no)
+                    lo = mid + 1;
+                else
+                    hi = mid;
+            }
+            slot_of[i] = lo;
+        }
+
+        lock_accounts(locked, unique + 1);
+
+        Account from_acc;
+        float total = 0;
+        for (int i = 0; i < count; i++)
+            total += amounts[i];
+
+        result = read_account(fd, from_offset, &from_acc);
+        if (result == ACC_OK && !from_acc.is_active)
+            result = ACC_INACTIVE;
+        if (result == ACC_OK && from_acc.balance < total)
+            result = ACC_INSUFFICIENT;
+        for (int t = 0; t < unique && result == ACC_OK; t++)
+        {
+            result = read_account(fd, offsets[t], &accounts[t]);
+            if (result == ACC_OK && !accounts[t].is_active)
+                result = ACC_INACTIVE;
+            if (result != ACC_OK)
+                *failed_index = targets[t].first;
+        }
+
+        LedgerEntry entry;
+        if (result == ACC_OK)
+        {
+            Account from_before = from_acc;
+            memcpy(before, accounts, sizeof(Account) * unique);
+            for (int i = 0; i < count; i++)
+            {
+                Account *to_acc = &accounts[slot_of[i]];
+                Transaction *sent = &records[2 * i], *received = &records[2 * i + 1];
+                sent->accountID = from_account;
+                sent->type = TRANSFER_SENT;
+                sent->amount = amounts[i];
+                sent->oldBalance = from_acc.balance;
+                from_acc.balance -= amounts[i];
+                sent->newBalance = from_acc.balance;
+
+                received->accountID = to_acc->account_no;
+                received->type = TRANSFER_RECEIVED;
+                received->amount = amounts[i];
+                received->oldBalance = to_acc->balance;
+                to_acc->balance += amounts[i];
+                received->newBalance = to_acc->balance;
+            }
+
+            // Credits first: if one fails, the written ones are restored below
+            int written = 0;
+            for (; written < unique && result == ACC_OK; written++)
+                result = write_account(fd, offsets[written], &accounts[written]);
+            if (result == ACC_OK)
+                result = write_account(fd, from_offset, &from_acc);
+            if (result != ACC_OK)
+            {
+                write_account(fd, from_offset, &from_before);
+                for (int t = 0; t < written; t++)
+                    write_account(fd, offsets[t], &before[t]);
+            }
+            else
+            {
+                ledger_submit_batch(&entry, records, 2 * count);
+            }
+        }
+
+        unlock_accounts(locked, unique + 1);
+        if (result == ACC_OK && ledger_wait(&entry) < 0)
+            result = ACC_IO_ERROR;
+    }
+
+    free(records);
+    free(locked);
+    free(before);
+    free(accounts);
+    free(offsets);
+    free(slot_of);
+    free(targets);
+    return result;
+}
+
+int account_set_active(int account_no, int is_active)
+{
+    int fd = data_fd(DATA_ACCOUNTS);
+    if (server_config.engine)
+    {
+        EngineCommand cmd = {.type = ENGINE_SET_ACTIVE, .account_no = account_no, .is_active = is_active};
+        engine_execute(&cmd);
+        return cmd.result;
+    }
+
+    long offset = find_account_offset(fd, account_no);
+    if (offset == -1)
+        return ACC_NOT_FOUND;
+
+    Account acc;
+    lock_account(account_no, 1);
+    int result = read_account(fd, offset, &acc);
+    if (result == ACC_OK)
+    {
+        acc.is_active = is_active;
+        result = write_account(fd, offset, &acc);
+    }
+    unlock_account(account_no);
+    return result;
+}
+
+int account_create(int account_no, float balance)
+{
+    lock_account_appends();
+    long locked_from = data_file_size(DATA_ACCOUNTS);
+    int result = ACC_EXISTS;
+    if (find_account_offset(data_fd(DATA_ACCOUNTS), account_no) == -1)
+    {
+        Account acc = {account_no, balance, 1};
+        result = (data_append(DATA_ACCOUNTS, &acc, sizeof(Account)) == -1) ? ACC_IO_ERROR : ACC_OK;
+    }
+    unlock_account_appends(locked_from);
+    return result;
+}
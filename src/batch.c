@@ -0,0 +1,309 @@
+#include "../includes/server.h"
+
+// Non-interactive command stream for bulk jobs (admin menu, Batch Commands).
+// One command per line, answered by one result line in the same order:
+//   ADD_USER <name> <password> <CUSTOMER|EMPLOYEE|MANAGER> [balance]
+//                                                            -> OK <n> <userID>
+//   OPEN_ACCOUNT <account_no> <initial_balance>              -> OK <n> <account_no>
+//   DEPOSIT <account_no> <amount>                            -> OK <n> <new balance>
+//   WITHDRAW <account_no> <amount>                           -> OK <n> <new balance>
+//   TRANSFER <from> <to> <amount>                            -> OK <n> <new balance of from>
+//   APPLY_LOAN <customer_id> <amount>                        -> OK <n> <loanID>
+//   PAYOUT <from> <count>, then count lines <to> <amount>    -> OK <n> <count>
+//   END                                                      -> END <succeeded> <failed>
+// A balance after CUSTOMER also opens the customer's account (account_no = userID).
+// A PAYOUT is all-or-nothing (account_bulk_transfer); its ERR names the payout
+// line at fault. Failures are answered with ERR <n> <reason>. Every line that has already arrived
+// is read before any of it runs, and consecutive balance changes in that group are
+// applied together under one acquisition of their account locks.
+
+#define BATCH_GROUP_MAX 512
+#define BATCH_PAYOUT_MAX 100000
+
+typedef struct
+{
+    char *data;
+    size_t len;
+    size_t capacity;
+} BatchOutput;
+
+static void append_output(BatchOutput *out, const char *line)
+{
+    size_t len = strlen(line);
+    if (out->len + len + 1 > out->capacity)
+    {
+        out->capacity = (out->len + len + 1) * 2;
+        out->data = realloc(out->data, out->capacity);
+    }
+    memcpy(out->data + out->len, line, len + 1);
+    out->len += len;
+}
+
+static const char *account_error(int result)
+{
+    switch (result)
+    {
+    case ACC_NOT_FOUND:
+        return "account not found";
+    case ACC_INACTIVE:
+        return "account deactivated";
+    case ACC_INSUFFICIENT:
+        return "insufficient balance";
+    case ACC_INVALID:
+        return "invalid amount";
+    case ACC_EXISTS:
+        return "account already exists";
+    default:
+        return "cannot access account data";
+    }
+}
+
+static int parse_role(const char *name, Role *role)
+{
+    if (strcmp(name, "CUSTOMER") == 0)
+        *role = CUSTOMER;
+    else if (strcmp(name, "EMPLOYEE") == 0)
+        *role = EMPLOYEE;
+    else if (strcmp(name, "MANAGER") == 0)
+        *role = MANAGER;
+    else
+        return -1;
+    return 0;
+}
+
+// Parses a balance change into op; returns -1 if the line is not one
+static int parse_account_op(const char *line, AccountOp *op)
+{
+    memset(op, 0, sizeof(*op));
+    if (sscanf(line, "DEPOSIT %d %f", &op->account_no, &op->amount) == 2)
+        op->type = DEPOSIT;
+    else if (sscanf(line, "WITHDRAW %d %f", &op->account_no, &op->amount) == 2)
+        op->type = WITHDRAWAL;
+    else if (sscanf(line, "TRANSFER %d %d %f", &op->account_no, &op->to_account, &op->amount) == 3)
+        op->type = TRANSFER_SENT;
+    else
+        return -1;
+    return 0;
+}
+
+// Runs a command that is not a balance change; returns 1 on success
+static int run_command(const char *line, long number, char *result, size_t size)
+{
+    char name[64], password[64], role_name[16];
+    int id;
+    float amount;
+    Role role;
+
+    int fields = sscanf(line, "ADD_USER %49s %19s %15s %f", name, password, role_name, &amount);
+    if (fields >= 3)
+    {
+        if (parse_role(role_name, &role) != 0)
+        {
+            snprintf(result, size, "ERR %ld unknown role\n", number);
+            return 0;
+        }
+        id = user_create(name, password, role);
+        if (id == -1)
+        {
+            snprintf(result, size, "ERR %ld cannot write user file\n", number);
+            return 0;
+        }
+        if (fields == 4 && role == CUSTOMER)
+        {
+            int status = account_create(id, amount);
+            if (status != ACC_OK)
+            {
+                snprintf(result, size, "ERR %ld user %d added, %s\n", number, id, account_error(status));
+                return 0;
+            }
+        }
+        snprintf(result, size, "OK %ld %d\n", number, id);
+        return 1;
+    }
+    if (sscanf(line, "OPEN_ACCOUNT %d %f", &id, &amount) == 2)
+    {
+        int status = account_create(id, amount);
+        if (status != ACC_OK)
+        {
+            snprintf(result, size, "ERR %ld %s\n", number, account_error(status));
+            return 0;
+        }
+        snprintf(result, size, "OK %ld %d\n", number, id);
+        return 1;
+    }
+    if (sscanf(line, "APPLY_LOAN %d %f", &id, &amount) == 2)
+    {
+        Account account;
+        int status = (amount <= 0) ? ACC_INVALID : account_get(id, &account);
+        int loan_id = (status == ACC_OK) ? loan_create(id, amount) : -1;
+        if (status == ACC_OK && loan_id == -1)
+            status = ACC_IO_ERROR;
+        if (status != ACC_OK)
+        {
+            snprintf(result, size, "ERR %ld %s\n", number, account_error(status));
+            return 0;
+        }
+        snprintf(result, size, "OK %ld %d\n", number, loan_id);
+        return 1;
+    }
+    snprintf(result, size, "ERR %ld unknown command\n", number);
+    return 0;
+}
+
+// Applies the queued balance changes and reports them in order
+static int flush_account_ops(AccountOp *ops, long *numbers, int count, BatchOutput *out)
+{
+    char line[128];
+    int succeeded = account_apply_batch(ops, count);
+    for (int i = 0; i < count; i++)
+    {
+        if (ops[i].result == ACC_OK)
+            snprintf(line, sizeof(line), "OK %ld %.2f\n", numbers[i], ops[i].balance);
+        else
+            snprintf(line, sizeof(line), "ERR %ld %s\n", numbers[i], account_error(ops[i].result));
+        append_output(out, line);
+    }
+    return succeeded;
+}
+
+// Runs a PAYOUT whose header is lines[*next - 1]. Its payout lines come from the
+// rest of the group first and then from the socket; *next moves past them.
+// Returns -1 without applying anything if the client disconnects meanwhile.
+static int run_payout(int sock, char (*lines)[256], int *next, int count, long number, char *result, size_t size)
+{
+    int from = 0, payouts = 0;
+    sscanf(lines[*next - 1], "PAYOUT %d %d", &from, &payouts);
+    if (payouts <= 0 || payouts > BATCH_PAYOUT_MAX)
+    {
+        snprintf(result, size, "ERR %ld payout count must be 1-%d\n", number, BATCH_PAYOUT_MAX);
+        return 0;
+    }
+
+    int *to_accounts = malloc(sizeof(int) * payouts);
+    float *amounts = malloc(sizeof(float) * payouts);
+    int bad_line = -1;
+    char line[256];
+    for (int i = 0; i < payouts; i++)
+    {
+        const char *text = line;
+        if (*next < count)
+            text = lines[(*next)++];
+        else if (read_from_client(sock, line, sizeof(line)) <= 0)
+        {
+            free(amounts);
+            free(to_accounts);
+            return -1;
+        }
+        if (sscanf(text, "%d %f", &to_accounts[i], &amounts[i]) != 2 && bad_line == -1)
+            bad_line = i;
+    }
+
+    int status = ACC_INVALID, failed_index = bad_line;
+    if (bad_line == -1)
+        status = account_bulk_transfer(from, to_accounts, amounts, payouts, &failed_index);
+    free(amounts);
+    free(to_accounts);
+
+    if (status != ACC_OK)
+    {
+        if (failed_index >= 0)
+            snprintf(result, size, "ERR %ld payout line %d: %s\n", number, failed_index + 1, account_error(status));
+        else
+            snprintf(result, size, "ERR %ld %s\n", number, account_error(status));
+        return 0;
+    }
+    snprintf(result, size, "OK %ld %d\n", number, payouts);
+    return 1;
+}
+
+void batch_session(int sock)
+{
+    char (*lines)[256] = malloc(sizeof(*lines) * BATCH_GROUP_MAX);
+    AccountOp *ops = malloc(sizeof(AccountOp) * BATCH_GROUP_MAX);
+    long numbers[BATCH_GROUP_MAX];
+    BatchOutput out = {0};
+    long next_number = 1, succeeded = 0, failed = 0;
+    int done = 0, disconnected = 0;
+
+    write_to_client(sock, "Batch mode: one command per line, END to finish.\n");
+    while (!done)
+    {
+        // Block for one line, then take whatever else has already arrived
+        int count = 0;
+        if (read_from_client(sock, lines[count], sizeof(lines[0])) <= 0)
+        {
+            disconnected = 1;
+            break;
+        }
+        count++;
+        while (count < BATCH_GROUP_MAX && strcmp(lines[count - 1], "END") != 0 && client_line_ready(sock))
+        {
+            if (read_from_client(sock, lines[count], sizeof(lines[0])) <= 0)
+                break;
+            count++;
+        }
+
+        out.len = 0;
+        int pending = 0;
+        for (int i = 0; i < count && !done;)
+        {
+            int current = i++;
+            if (lines[current][0] == '\0')
+                continue;
+            if (strcmp(lines[current], "END") == 0)
+            {
+                done = 1;
+                break;
+            }
+
+            long number = next_number++;
+            if (parse_account_op(lines[current], &ops[pending]) == 0)
+            {
+                numbers[pending++] = number;
+                continue;
+            }
+
+            // Other commands keep their place in the stream
+            if (pending > 0)
+            {
+                int ok = flush_account_ops(ops, numbers, pending, &out);
+                succeeded += ok;
+                failed += pending - ok;
+                pending = 0;
+            }
+            char result[128];
+            int ok = (strncmp(lines[current], "PAYOUT ", 7) == 0)
+                         ? run_payout(sock, lines, &i, count, number, result, sizeof(result))
+                         : run_command(lines[current], number, result, sizeof(result));
+            if (ok < 0)
+            {
+                done = disconnected = 1;
+                break;
+            }
+            if (ok)
+                succeeded++;
+            else
+                failed++;
+            append_output(&out, result);
+        }
+        if (pending > 0)
+        {
+            int ok = flush_account_ops(ops, numbers, pending, &out);
+            succeeded += ok;
+            failed += pending - ok;
+        }
+        if (out.len > 0 && !disconnected)
+            write_client_bytes(sock, out.data, out.len);
+    }
+
+    if (!disconnected)
+    {
+        char summary[64];
+        snprintf(summary, sizeof(summary), "END %ld %ld\n", succeeded, failed);
+        write_to_client(sock, summary);
+    }
+
+    free(out.data);
+    free(ops);
+    free(lines);
+}
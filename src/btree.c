@@ -0,0 +1,584 @@
+#include "../includes/server.h"
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+// Persistent B+tree indexes (users.idx, accounts.idx, loans.idx) from the ID at
+// the start of each record to the record's offset in its data file. Page 0 holds
+// the header and every other page is one node; leaves are chained left to right
+// for ordered range scans. The file is mapped into an address range reserved at
+// startup (as in src/account_store.c), so a lookup visits one page per level
+// without a system call.
+// data_append inserts each key while it still holds the file's append lock, so
+// keys arrive in file order and the header's `covered` always ends a fully
+// indexed prefix of the data file; at startup only records past it are added.
+// Every INDEX_SYNC_INSERTS inserts the node pages are synced and only then the
+// header, so the header on disk never describes pages that are not there. Before
+// a page of the synced tree first changes, its old contents go to the journal
+// (users.idx-journal and so on); at startup the journal puts those pages back,
+// which returns the file to its last synced state whatever the crash left in it.
+
+#define INDEX_MAGIC 0x31584449 // "IDX1"
+#define INDEX_PAGE 4096
+#define INDEX_MAP_RESERVE (1L << 31)        // address space reserved per index
+#define INDEX_MAP_CHUNK (256L * INDEX_PAGE) // the file grows this much at a time
+#define INDEX_MAX_HEIGHT 16
+#define INDEX_SCAN_BATCH 256
+#define INDEX_SYNC_INSERTS 1024
+#define LEAF_MAX 340  // (INDEX_PAGE - 8) / (sizeof(int) + sizeof(long))
+#define INNER_MAX 509 // (INDEX_PAGE - 12) / (2 * sizeof(int))
+
+typedef struct
+{
+    int magic;
+    int page_size;
+    long covered; // bytes of the data file whose records are all indexed
+    long keys;
+    int root;
+    int pages;  // pages in use, header included
+    int height; // 1 while the root is a leaf
+    int dirty;  // set from a rebuild until its first sync
+} IndexHeader;
+
+typedef struct
+{
+    short leaf;
+    short count;
+    int next; // page of the leaf to the right, 0 for the last one
+    int keys[LEAF_MAX];
+    long offsets[LEAF_MAX];
+} LeafNode;
+
+// children[i] holds the keys below keys[i], children[count] the rest
+typedef struct
+{
+    short leaf;
+    short count;
+    int unused;
+    int keys[INNER_MAX];
+    int children[INNER_MAX + 1];
+} InnerNode;
+
+static IndexHeader *header_of(OffsetIndex *index)
+{
+    return (IndexHeader *)index->pages;
+}
+
+static void *page_at(OffsetIndex *index, int page)
+{
+    return index->pages + (long)page * INDEX_PAGE;
+}
+
+// Grows the file and its mapping to at least pages pages
+static int reserve_pages(OffsetIndex *index, long pages)
+{
+    long needed = pages * INDEX_PAGE;
+    if (needed <= index->mapped_len)
+        return 0;
+
+    long len = index->mapped_len;
+    while (len < needed)
+        len += INDEX_MAP_CHUNK;
+    if (len > INDEX_MAP_RESERVE || ftruncate(index->fd, len) < 0)
+        return -1;
+    if (mmap(index->pages + index->mapped_len, len - index->mapped_len, PROT_READ | PROT_WRITE,
+             MAP_SHARED | MAP_FIXED, index->fd, index->mapped_len) == MAP_FAILED)
+        return -1;
+    index->mapped_len = len;
+    return 0;
+}
+
+// Returns a zeroed node page, or -1 if the file cannot grow
+static int new_page(OffsetIndex *index, int leaf)
+{
+    IndexHeader *header = header_of(index);
+    if (reserve_pages(index, header->pages + 1L) < 0)
+        return -1;
+    int page = header->pages++;
+    LeafNode *node = page_at(index, page);
+    memset(node, 0, INDEX_PAGE);
+    node->leaf = leaf;
+    return page;
+}
+
+// Pre-image of one page in the journal
+typedef struct
+{
+    int page;
+    int unused;
+    char data[INDEX_PAGE];
+} JournalEntry;
+
+// Copies each synced page in pages that has not changed since the last sync to
+// the journal, and makes the journal durable before any of them is modified
+static int journal_pages(OffsetIndex *index, const int *pages, int count)
+{
+    int added = 0;
+    for (int i = 0; i < count; i++)
+    {
+        int page = pages[i];
+        if (page >= index->synced_pages || index->journaled[page])
+            continue;
+        JournalEntry entry = {page, 0, {0}};
+        memcpy(entry.data, page_at(index, page), INDEX_PAGE);
+        if (pwrite(index->journal_fd, &entry, sizeof(entry), index->journal_len) != sizeof(entry))
+            return -1;
+        index->journal_len += sizeof(entry);
+        added = 1;
+    }
+    if (added && fdatasync(index->journal_fd) < 0)
+        return -1;
+    for (int i = 0; i < count; i++)
+    {
+        if (pages[i] < index->synced_pages)
+            index->journaled[pages[i]] = 1;
+    }
+    return 0;
+}
+
+// Empties the journal; the pages now on disk are the ones to return to
+static int clear_journal(OffsetIndex *index)
+{
+    if (ftruncate(index->journal_fd, 0) < 0 || fdatasync(index->journal_fd) < 0)
+        return -1;
+    index->journal_len = 0;
+    return 0;
+}
+
+// Writes the node pages, then the header, then drops the journal
+static int sync_index(OffsetIndex *index)
+{
+    IndexHeader *header = header_of(index);
+    if (msync(index->pages + INDEX_PAGE, (long)(header->pages - 1) * INDEX_PAGE, MS_SYNC) < 0)
+        return -1;
+    header->dirty = 0;
+    if (msync(index->pages, INDEX_PAGE, MS_SYNC) < 0 || clear_journal(index) < 0)
+        return -1;
+
+    unsigned char *journaled = calloc(header->pages, 1);
+    if (journaled == NULL)
+        return -1;
+    free(index->journaled);
+    index->journaled = journaled;
+    index->synced_pages = header->pages;
+    return 0;
+}
+
+// Puts back every page journaled before the last run stopped
+static int restore_journal(OffsetIndex *index)
+{
+    JournalEntry entry;
+    long at = 0;
+    int restored = 0;
+    // A torn last entry was never followed by a change to its page
+    while (pread(index->journal_fd, &entry, sizeof(entry), at) == sizeof(entry))
+    {
+        if (entry.page >= 0 && (long)(entry.page + 1) * INDEX_PAGE <= index->mapped_len)
+        {
+            memcpy(page_at(index, entry.page), entry.data, INDEX_PAGE);
+            restored++;
+        }
+        at += sizeof(entry);
+    }
+    if (restored > 0)
+    {
+        printf("Restored %d pages of %s.\n", restored, index->path);
+        if (msync(index->pages, index->mapped_len, MS_SYNC) < 0)
+            return -1;
+    }
+    return clear_journal(index);
+}
+
+// First position whose key is >= key
+static int lower_bound(const int *keys, int count, int key)
+{
+    int low = 0, high = count;
+    while (low < high)
+    {
+        int mid = (low + high) / 2;
+        if (keys[mid] < key)
+            low = mid + 1;
+        else
+            high = mid;
+    }
+    return low;
+}
+
+// First position whose key is > key: the child of an inner node to follow
+static int upper_bound(const int *keys, int count, int key)
+{
+    int low = 0, high = count;
+    while (low < high)
+    {
+        int mid = (low + high) / 2;
+        if (keys[mid] <= key)
+            low = mid + 1;
+        else
+            high = mid;
+    }
+    return low;
+}
+
+// Leaf whose range holds key
+static LeafNode *find_leaf(OffsetIndex *index, int key)
+{
+    IndexHeader *header = header_of(index);
+    int page = header->root;
+    for (int level = 1; level < header->height; level++)
+    {
+        InnerNode *node = page_at(index, page);
+        page = node->children[upper_bound(node->keys, node->count, key)];
+    }
+    return page_at(index, page);
+}
+
+static long tree_lookup(OffsetIndex *index, int key)
+{
+    LeafNode *leaf = find_leaf(index, key);
+    int pos = lower_bound(leaf->keys, leaf->count, key);
+    return (pos < leaf->count && leaf->keys[pos] == key) ? leaf->offsets[pos] : -1;
+}
+
+static void leaf_insert(LeafNode *leaf, int pos, int key, long offset)
+{
+    memmove(leaf->keys + pos + 1, leaf->keys + pos, sizeof(int) * (leaf->count - pos));
+    memmove(leaf->offsets + pos + 1, leaf->offsets + pos, sizeof(long) * (leaf->count - pos));
+    leaf->keys[pos] = key;
+    leaf->offsets[pos] = offset;
+    leaf->count++;
+}
+
+// Splits a full leaf and inserts key; *separator and *sibling describe the new
+// right half for the parent
+static int split_leaf(OffsetIndex *index, LeafNode *leaf, int pos, int key, long offset,
+                      int append, int *separator, int *sibling)
+{
+    int page = new_page(index, 1);
+    if (page < 0)
+        return -1;
+    LeafNode *right = page_at(index, page);
+
+    // IDs mostly arrive in increasing order; starting a new leaf for a key past
+    // the end of the last one leaves the full leaf full
+    int keep = append ? leaf->count : (leaf->count + 1) / 2;
+    right->count = leaf->count - keep;
+    memcpy(right->keys, leaf->keys + keep, sizeof(int) * right->count);
+    memcpy(right->offsets, leaf->offsets + keep, sizeof(long) * right->count);
+    leaf->count = keep;
+    right->next = leaf->next;
+    leaf->next = page;
+
+    if (pos < keep)
+        leaf_insert(leaf, pos, key, offset);
+    else
+        leaf_insert(right, pos - keep, key, offset);
+    *separator = right->keys[0];
+    *sibling = page;
+    return 0;
+}
+
+// Adds separator and the child to its right at slot at; when the node is full it
+// is split and *separator and *sibling are replaced by the node's own new half
+static int inner_insert(OffsetIndex *index, InnerNode *node, int at, int append, int *separator, int *sibling)
+{
+    if (node->count < INNER_MAX)
+    {
+        memmove(node->keys + at + 1, node->keys + at, sizeof(int) * (node->count - at));
+        memmove(node->children + at + 2, node->children + at + 1, sizeof(int) * (node->count - at));
+        node->keys[at] = *separator;
+        node->children[at + 1] = *sibling;
+        node->count++;
+        *sibling = 0;
+        return 0;
+    }
+
+    int page = new_page(index, 0);
+    if (page < 0)
+        return -1;
+    InnerNode *right = page_at(index, page);
+
+    int keys[INNER_MAX + 1], children[INNER_MAX + 2];
+    memcpy(keys, node->keys, sizeof(int) * at);
+    keys[at] = *separator;
+    memcpy(keys + at + 1, node->keys + at, sizeof(int) * (node->count - at));
+    memcpy(children, node->children, sizeof(int) * (at + 1));
+    children[at + 1] = *sibling;
+    memcpy(children + at + 2, node->children + at + 1, sizeof(int) * (node->count - at));
+
+    // keys[mid] moves up; the left node keeps everything before it
+    int total = node->count + 1;
+    int mid = append ? total - 1 : total / 2;
+    node->count = mid;
+    memcpy(node->keys, keys, sizeof(int) * mid);
+    memcpy(node->children, children, sizeof(int) * (mid + 1));
+    right->count = total - mid - 1;
+    memcpy(right->keys, keys + mid + 1, sizeof(int) * right->count);
+    memcpy(right->children, children + mid + 1, sizeof(int) * (right->count + 1));
+    *separator = keys[mid];
+    *sibling = page;
+    return 0;
+}
+
+// Inserts key unless it is already present (the first offset seen wins)
+static int tree_insert(OffsetIndex *index, int key, long offset)
+{
+    IndexHeader *header = header_of(index);
+    // Every page a split may need is allocated up front, so a file that cannot
+    // grow is reported before any node changes
+    if (header->height == INDEX_MAX_HEIGHT || reserve_pages(index, header->pages + header->height + 1L) < 0)
+        return -1;
+
+    int path[INDEX_MAX_HEIGHT], slots[INDEX_MAX_HEIGHT];
+    int page = header->root, append = 1;
+    for (int level = 0; level < header->height - 1; level++)
+    {
+        InnerNode *node = page_at(index, page);
+        path[level] = page;
+        slots[level] = upper_bound(node->keys, node->count, key);
+        append = append && slots[level] == node->count;
+        page = node->children[slots[level]];
+    }
+
+    LeafNode *leaf = page_at(index, page);
+    // The header, the leaf and, when the leaf may split, the nodes above it
+    int touched[INDEX_MAX_HEIGHT + 1] = {0, page};
+    int count = 2;
+    for (int level = 0; leaf->count == LEAF_MAX && level < header->height - 1; level++)
+        touched[count++] = path[level];
+    if (journal_pages(index, touched, count) < 0)
+        return -1;
+
+    int pos = lower_bound(leaf->keys, leaf->count, key);
+    if (pos < leaf->count && leaf->keys[pos] == key)
+        return 0;
+    header->keys++;
+    if (leaf->count < LEAF_MAX)
+    {
+        leaf_insert(leaf, pos, key, offset);
+        return 0;
+    }
+
+    int separator, sibling;
+    append = append && pos == leaf->count && leaf->next == 0;
+    if (split_leaf(index, leaf, pos, key, offset, append, &separator, &sibling) < 0)
+        return -1;
+    for (int level = header->height - 2; level >= 0 && sibling != 0; level--)
+    {
+        if (inner_insert(index, page_at(index, path[level]), slots[level], append, &separator, &sibling) < 0)
+            return -1;
+    }
+    if (sibling == 0)
+        return 0;
+
+    int root = new_page(index, 0);
+    if (root < 0)
+        return -1;
+    InnerNode *node = page_at(index, root);
+    node->count = 1;
+    node->keys[0] = separator;
+    node->children[0] = header->root;
+    node->children[1] = sibling;
+    header->root = root;
+    header->height++;
+    return 0;
+}
+
+// Starts an empty tree in place of whatever the file held
+static int reset_index(OffsetIndex *index)
+{
+    IndexHeader *header = header_of(index);
+    memset(header, 0, INDEX_PAGE);
+    header->magic = INDEX_MAGIC;
+    header->page_size = INDEX_PAGE;
+    header->pages = 1;
+    header->height = 1;
+    header->dirty = 1;
+    // Nothing of the old tree is kept, so only the dirty header has to reach the
+    // disk before the pages it used are overwritten
+    index->synced_pages = 0;
+    if (msync(index->pages, INDEX_PAGE, MS_SYNC) < 0)
+        return -1;
+    header->root = new_page(index, 1);
+    return header->root < 0 ? -1 : 0;
+}
+
+// Whether the file holds a complete tree that matches the data file
+static int index_usable(OffsetIndex *index, long file_size)
+{
+    IndexHeader *header = header_of(index);
+    long covered = header->covered;
+    if (file_size < 2 * INDEX_PAGE || header->magic != INDEX_MAGIC || header->page_size != INDEX_PAGE ||
+        header->dirty || header->pages < 2 || (long)header->pages * INDEX_PAGE > file_size ||
+        header->root < 1 || header->root >= header->pages || header->height < 1 ||
+        header->height > INDEX_MAX_HEIGHT || covered % (long)index->record_size != 0 ||
+        covered > data_file_size(index->file))
+        return 0;
+    if (covered == 0)
+        return 1;
+
+    // The last record covered must be indexed (at its own offset or a duplicate's)
+    int id;
+    if (pread(data_fd(index->file), &id, sizeof(int), covered - index->record_size) != sizeof(int))
+        return 0;
+    long offset = tree_lookup(index, id);
+    return offset != -1 && offset < covered;
+}
+
+// Inserts under the write lock; covered only moves past a record once every
+// record before it is in the tree
+static void insert_locked(OffsetIndex *index, int id, long offset)
+{
+    IndexHeader *header = header_of(index);
+    if (tree_insert(index, id, offset) < 0)
+        fprintf(stderr, "Failed to update %s\n", index->path);
+    else if (offset == header->covered)
+        header->covered = offset + index->record_size;
+    index->count = (int)header->keys;
+    if (++index->unsynced >= INDEX_SYNC_INSERTS)
+    {
+        index->unsynced = 0;
+        if (sync_index(index) < 0)
+            fprintf(stderr, "Failed to sync %s: %s\n", index->path, strerror(errno));
+    }
+}
+
+// Indexes every record appended after the tree was last written
+static void catch_up(OffsetIndex *index)
+{
+    int fd = data_fd(index->file);
+    size_t record_size = index->record_size;
+    long offset = header_of(index)->covered, end = data_file_size(index->file);
+    char *batch = malloc(record_size * INDEX_SCAN_BATCH);
+    ssize_t bytes;
+    while (offset < end &&
+           (bytes = pread(fd, batch, record_size * INDEX_SCAN_BATCH, offset)) >= (ssize_t)record_size)
+    {
+        for (ssize_t pos = 0; pos + (ssize_t)record_size <= bytes && offset < end; pos += record_size)
+        {
+            int id;
+            memcpy(&id, batch + pos, sizeof(int));
+            insert_locked(index, id, offset);
+            offset += record_size;
+        }
+    }
+    free(batch);
+}
+
+// Opens (or creates) the index of file at path, rebuilding it if it does not
+// match the data, and indexes records appended since it was last written
+void index_open(OffsetIndex *index, const char *path, DataFile file, size_t record_size)
+{
+    pthread_rwlock_init(&index->lock, NULL);
+    index->path = path;
+    index->file = file;
+    index->record_size = record_size;
+    index->mapped_len = 0;
+    index->ready = 0;
+    index->journal_len = 0;
+    index->synced_pages = 0;
+    index->journaled = NULL;
+    index->unsynced = 0;
+
+    char journal_path[256];
+    snprintf(journal_path, sizeof(journal_path), "%s-journal", path);
+    index->fd = open(path, O_RDWR | O_CREAT, 0666);
+    index->journal_fd = open(journal_path, O_RDWR | O_CREAT, 0666);
+    void *base = mmap(NULL, INDEX_MAP_RESERVE, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    struct stat st;
+    if (index->fd < 0 || index->journal_fd < 0 || base == MAP_FAILED || fstat(index->fd, &st) < 0)
+    {
+        fprintf(stderr, "Failed to open %s: %s\n", path, strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+    index->pages = base;
+    long pages = (st.st_size + INDEX_PAGE - 1) / INDEX_PAGE;
+    if (reserve_pages(index, pages > 2 ? pages : 2) < 0 || restore_journal(index) < 0)
+    {
+        fprintf(stderr, "Failed to map %s\n", path);
+        exit(EXIT_FAILURE);
+    }
+
+    if (!index_usable(index, st.st_size))
+    {
+        if (st.st_size > 0)
+            printf("Rebuilding %s.\n", path);
+        if (reset_index(index) < 0)
+        {
+            fprintf(stderr, "Failed to initialise %s\n", path);
+            exit(EXIT_FAILURE);
+        }
+    }
+    else
+    {
+        index->synced_pages = header_of(index)->pages;
+        index->journaled = calloc(index->synced_pages, 1);
+    }
+    catch_up(index);
+    if (sync_index(index) < 0)
+    {
+        fprintf(stderr, "Failed to sync %s: %s\n", path, strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+    index->count = (int)header_of(index)->keys;
+    index->unsynced = 0;
+    index->ready = 1;
+}
+
+long index_lookup(OffsetIndex *index, int id)
+{
+    pthread_rwlock_rdlock(&index->lock);
+    long offset = tree_lookup(index, id);
+    pthread_rwlock_unlock(&index->lock);
+    return offset;
+}
+
+// Keeps the first offset seen for an id, matching the old linear scan. Called by
+// data_append in file order.
+void index_insert(OffsetIndex *index, int id, long offset)
+{
+    pthread_rwlock_wrlock(&index->lock);
+    insert_locked(index, id, offset);
+    pthread_rwlock_unlock(&index->lock);
+}
+
+// Copies up to max (id, offset) pairs with from <= id <= to, in ID order; returns how many
+int index_range(OffsetIndex *index, int from, int to, int *ids, long *offsets, int max)
+{
+    int copied = 0;
+    pthread_rwlock_rdlock(&index->lock);
+    LeafNode *leaf = find_leaf(index, from);
+    int pos = lower_bound(leaf->keys, leaf->count, from);
+    while (copied < max)
+    {
+        if (pos == leaf->count)
+        {
+            if (leaf->next == 0)
+                break;
+            leaf = page_at(index, leaf->next);
+            pos = 0;
+            continue;
+        }
+        if (leaf->keys[pos] > to)
+            break;
+        ids[copied] = leaf->keys[pos];
+        offsets[copied++] = leaf->offsets[pos++];
+    }
+    pthread_rwlock_unlock(&index->lock);
+    return copied;
+}
+
+// Highest indexed ID, or -1 when the index is empty
+long index_max_id(OffsetIndex *index)
+{
+    pthread_rwlock_rdlock(&index->lock);
+    IndexHeader *header = header_of(index);
+    int page = header->root;
+    for (int level = 1; level < header->height; level++)
+    {
+        InnerNode *node = page_at(index, page);
+        page = node->children[node->count];
+    }
+    LeafNode *leaf = page_at(index, page);
+    long id = leaf->count > 0 ? leaf->keys[leaf->count - 1] : -1;
+    pthread_rwlock_unlock(&index->lock);
+    return id;
+}
@@ -0,0 +1,451 @@
+#include "../includes/server.h"
+#include <sys/stat.h>
+
+// Periodic checkpoints (BANK_CHECKPOINT_SECONDS) so a restart does not rescan the
+// whole transaction log. A background thread records the ledger position P up to
+// which every transaction record and the account write behind it is complete,
+// then copies every account balance. Posting lists are not copied: each sealed
+// segment gets a posting file beside it once, and startup loads those below P.
+// The offset indexes persist themselves (src/btree.c).
+// Writers keep running meanwhile, so balances may already include changes logged
+// at or after P; that is harmless because every record holds an absolute balance,
+// and on restart the log is replayed from where the posting files end, at most P
+// (replay_log), setting each account it touches to its newest logged balance. The
+// file is written under a temporary name, synced and renamed over CHECKPOINT_FILE.
+
+#define CHECKPOINT_MAGIC 0x33504B43 // "CKP3"
+#define POSTINGS_MAGIC 0x31545350   // "PST1"
+#define CHECKPOINT_BUFFER 65536
+#define CHECKPOINT_BATCH 256
+
+typedef struct
+{
+    int magic;
+    int reserved;
+    time_t taken;
+    long log_records;                 // P: the log is replayed from this record on
+    long file_sizes[DATA_FILE_COUNT]; // bytes of each data file covered
+} CheckpointHeader;
+
+// A posting file: this header, then per account its number, record count and
+// record numbers, then POSTINGS_MAGIC
+typedef struct
+{
+    int magic;
+    int reserved;
+    long base;  // the segment's first record number
+    long count; // its records
+    long lists;
+} PostingsHeader;
+
+typedef struct
+{
+    int account_no;
+    long record_no;
+} Posting;
+
+// Sequential, buffered access to the checkpoint file
+typedef struct
+{
+    int fd;
+    int failed;
+    size_t len; // bytes buffered (writing) or available (reading)
+    size_t pos; // next byte to hand out when reading
+    char data[CHECKPOINT_BUFFER];
+} CheckpointFile;
+
+static CheckpointHeader loaded;
+static int have_checkpoint;
+static float *checkpoint_balances; // by account slot, for replay_log
+static int postings_saved;         // leading sealed segments known to have a posting file
+
+static void flush_out(CheckpointFile *out)
+{
+    size_t done = 0;
+    while (!out->failed && done < out->len)
+    {
+        ssize_t written = write(out->fd, out->data + done, out->len - done);
+        if (written < 0 && errno != EINTR)
+            out->failed = 1;
+        else if (written > 0)
+            done += written;
+    }
+    out->len = 0;
+}
+
+static void put(CheckpointFile *out, const void *data, size_t size)
+{
+    const char *next = data;
+    while (size > 0)
+    {
+        if (out->len == CHECKPOINT_BUFFER)
+            flush_out(out);
+        size_t chunk = CHECKPOINT_BUFFER - out->len < size ? CHECKPOINT_BUFFER - out->len : size;
+        memcpy(out->data + out->len, next, chunk);
+        out->len += chunk;
+        next += chunk;
+        size -= chunk;
+    }
+}
+
+// Returns 0, or -1 if the file ends first
+static int get(CheckpointFile *in, void *data, size_t size)
+{
+    char *next = data;
+    while (size > 0)
+    {
+        if (in->pos == in->len)
+        {
+            ssize_t bytes = read(in->fd, in->data, CHECKPOINT_BUFFER);
+            if (bytes <= 0)
+                return -1;
+            in->len = bytes;
+            in->pos = 0;
+        }
+        size_t chunk = in->len - in->pos < size ? in->len - in->pos : size;
+        memcpy(next, in->data + in->pos, chunk);
+        in->pos += chunk;
+        next += chunk;
+        size -= chunk;
+    }
+    return 0;
+}
+
+// Current balance of every account record below size, by slot
+static void write_balances(CheckpointFile *out, long size)
+{
+    Account batch[CHECKPOINT_BATCH];
+    int fd = data_fd(DATA_ACCOUNTS);
+    for (long offset = 0; offset < size;)
+    {
+        long wanted = (size - offset) / sizeof(Account) < CHECKPOINT_BATCH ? (size - offset) / sizeof(Account) : CHECKPOINT_BATCH;
+        if (pread(fd, batch, sizeof(Account) * wanted, offset) < (ssize_t)(sizeof(Account) * wanted))
+        {
+            out->failed = 1;
+            break;
+        }
+        for (long i = 0; i < wanted; i++, offset += sizeof(Account))
+        {
+            // Read through account_get so the value is consistent; duplicate
+            // records that the index does not point at keep their file value
+            Account acc;
+            if (find_account_offset(fd, batch[i].account_no) == offset &&
+                account_get(batch[i].account_no, &acc) == ACC_OK)
+                batch[i].balance = acc.balance;
+            put(out, &batch[i].balance, sizeof(float));
+        }
+    }
+}
+
+static int compare_postings(const void *a, const void *b)
+{
+    const Posting *x = a, *y = b;
+    if (x->account_no != y->account_no)
+        return (x->account_no > y->account_no) - (x->account_no < y->account_no);
+    return (x->record_no > y->record_no) - (x->record_no < y->record_no);
+}
+
+// Writes the posting file of a sealed segment from its records
+static int write_segment_postings(const char *name, const SegmentInfo *info)
+{
+    Posting *postings = malloc(sizeof(Posting) * (info->count + 1));
+    Transaction batch[CHECKPOINT_BATCH];
+    long read = 0;
+    int count;
+    while (read < info->count &&
+           (count = segments_read(info->base + read, batch, CHECKPOINT_BATCH)) > 0)
+    {
+        for (int i = 0; i < count && read < info->count; i++, read++)
+        {
+            postings[read].account_no = batch[i].accountID;
+            postings[read].record_no = info->base + read;
+        }
+    }
+    qsort(postings, read, sizeof(Posting), compare_postings);
+
+    PostingsHeader header = {POSTINGS_MAGIC, 0, info->base, info->count, 0};
+    for (long i = 0; i < read; i++)
+        if (i == 0 || postings[i].account_no != postings[i - 1].account_no)
+            header.lists++;
+
+    char tmp_name[80];
+    snprintf(tmp_name, sizeof(tmp_name), "%s.tmp", name);
+    CheckpointFile *out = calloc(1, sizeof(CheckpointFile));
+    out->fd = open(tmp_name, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+    out->failed = out->fd < 0 || read != info->count;
+    if (out->fd >= 0)
+    {
+        put(out, &header, sizeof(header));
+        for (long i = 0, end; i < read; i = end)
+        {
+            for (end = i; end < read && postings[end].account_no == postings[i].account_no; end++)
+                ;
+            int records = (int)(end - i);
+            put(out, &postings[i].account_no, sizeof(int));
+            put(out, &records, sizeof(int));
+            for (long j = i; j < end; j++)
+                put(out, &postings[j].record_no, sizeof(long));
+        }
+        int trailer = POSTINGS_MAGIC;
+        put(out, &trailer, sizeof(trailer));
+        flush_out(out);
+        if (fdatasync(out->fd) < 0 || close(out->fd) < 0)
+            out->failed = 1;
+    }
+
+    int result = (!out->failed && rename(tmp_name, name) == 0) ? 0 : -1;
+    if (result < 0)
+    {
+        perror("Failed to write posting file");
+        unlink(tmp_name);
+    }
+    free(out);
+    free(postings);
+    return result;
+}
+
+// Gives every sealed segment that lacks one its posting file
+static void save_segment_postings()
+{
+    SegmentInfo info;
+    for (; segments_info(postings_saved, &info) == 0 && info.sealed; postings_saved++)
+    {
+        char name[64];
+        segment_postings_name(name, sizeof(name), info.base);
+        if (access(name, F_OK) != 0 && write_segment_postings(name, &info) < 0)
+            break;
+    }
+}
+
+// Adds the postings of one sealed segment from its file; returns -1, having
+// added nothing, if the file is missing or does not match the segment
+static int load_segment_postings(const SegmentInfo *info)
+{
+    char name[64];
+    segment_postings_name(name, sizeof(name), info->base);
+    int fd = open(name, O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) < 0 || st.st_size < (off_t)(sizeof(PostingsHeader) + sizeof(int)))
+    {
+        if (fd >= 0)
+            close(fd);
+        return -1;
+    }
+
+    // Checked whole before any of it reaches the index
+    char *data = malloc(st.st_size);
+    int failed = pread(fd, data, st.st_size, 0) != st.st_size;
+    close(fd);
+    PostingsHeader header;
+    memcpy(&header, data, sizeof(header));
+    int trailer = 0;
+    memcpy(&trailer, data + st.st_size - sizeof(int), sizeof(int));
+    failed = failed || header.magic != POSTINGS_MAGIC || trailer != POSTINGS_MAGIC ||
+             header.base != info->base || header.count != info->count;
+
+    long pos = sizeof(header), total = 0;
+    for (long l = 0; l < header.lists && !failed; l++)
+    {
+        int list[2]; // account_no, records
+        failed = pos + (long)sizeof(list) > st.st_size;
+        if (!failed)
+            memcpy(list, data + pos, sizeof(list));
+        failed = failed || list[1] <= 0 || pos + (long)sizeof(list) + list[1] * (long)sizeof(long) > st.st_size;
+        if (!failed)
+        {
+            pos += sizeof(list) + list[1] * sizeof(long);
+            total += list[1];
+        }
+    }
+    failed = failed || total != info->count || pos + (long)sizeof(int) != st.st_size;
+
+    for (long l = 0, at = sizeof(header); l < header.lists && !failed; l++)
+    {
+        int list[2];
+        memcpy(list, data + at, sizeof(list));
+        posting_extend(&transaction_index, list[0], (const long *)(data + at + sizeof(list)), list[1]);
+        at += sizeof(list) + list[1] * sizeof(long);
+    }
+    free(data);
+    return failed ? -1 : 0;
+}
+
+static int take_checkpoint(CheckpointHeader *last)
+{
+    CheckpointHeader header;
+    memset(&header, 0, sizeof(header));
+    header.magic = CHECKPOINT_MAGIC;
+    header.taken = time(NULL);
+    header.log_records = ledger_published_records();
+    for (int f = 0; f < DATA_FILE_COUNT; f++)
+        header.file_sizes[f] = data_file_size((DataFile)f);
+    if (last->magic == CHECKPOINT_MAGIC && last->log_records == header.log_records &&
+        memcmp(last->file_sizes, header.file_sizes, sizeof(header.file_sizes)) == 0)
+        return 0; // nothing has changed
+
+    save_segment_postings();
+
+    CheckpointFile *out = calloc(1, sizeof(CheckpointFile));
+    out->fd = open(CHECKPOINT_FILE ".tmp", O_WRONLY | O_CREAT | O_TRUNC, 0666);
+    out->failed = out->fd < 0;
+    if (!out->failed)
+    {
+        put(out, &header, sizeof(header));
+        write_balances(out, header.file_sizes[DATA_ACCOUNTS]);
+        int trailer = CHECKPOINT_MAGIC;
+        put(out, &trailer, sizeof(trailer));
+        flush_out(out);
+        if (fdatasync(out->fd) < 0 || close(out->fd) < 0)
+            out->failed = 1;
+    }
+
+    int result = (!out->failed && rename(CHECKPOINT_FILE ".tmp", CHECKPOINT_FILE) == 0) ? 0 : -1;
+    if (result == 0)
+        *last = header;
+    else
+        perror("Failed to write checkpoint");
+    free(out);
+    return result;
+}
+
+static void *checkpoint_main(void *arg)
+{
+    int seconds = *(int *)arg;
+    CheckpointHeader last = loaded;
+    while (1)
+    {
+        sleep(seconds);
+        take_checkpoint(&last);
+    }
+    return NULL;
+}
+
+void start_checkpoints(int seconds)
+{
+    static int interval;
+    if (seconds <= 0)
+        return;
+    interval = seconds;
+    pthread_t thread;
+    if (pthread_create(&thread, NULL, checkpoint_main, &interval) != 0)
+    {
+        perror("Failed to start checkpoint thread");
+        return;
+    }
+    pthread_detach(thread);
+}
+
+// Checks the header against the files it claims to cover and the trailer
+static int checkpoint_valid(int fd, const CheckpointHeader *header)
+{
+    struct stat st;
+    int trailer = 0;
+    if (header->magic != CHECKPOINT_MAGIC || fstat(fd, &st) < 0 ||
+        pread(fd, &trailer, sizeof(trailer), st.st_size - sizeof(trailer)) != sizeof(trailer) ||
+        trailer != CHECKPOINT_MAGIC || header->log_records > segments_record_count())
+        return 0;
+    for (int f = 0; f < DATA_FILE_COUNT; f++)
+        if (header->file_sizes[f] > data_file_size((DataFile)f))
+            return 0;
+    return 1;
+}
+
+// Loads the balances in CHECKPOINT_FILE and the posting files of the sealed
+// segments below its P. Returns the record number to replay the log from (where
+// those posting files end), or -1 if there is no usable checkpoint.
+long load_checkpoint()
+{
+    int fd = open(CHECKPOINT_FILE, O_RDONLY);
+    if (fd < 0)
+        return -1;
+
+    CheckpointFile *in = calloc(1, sizeof(CheckpointFile));
+    in->fd = fd;
+    CheckpointHeader header;
+    if (get(in, &header, sizeof(header)) < 0 || !checkpoint_valid(fd, &header))
+    {
+        // Older than the data (e.g. restored files or a lost log tail): rebuild
+        printf("Ignoring stale or damaged %s.\n", CHECKPOINT_FILE);
+        close(fd);
+        free(in);
+        unlink(CHECKPOINT_FILE);
+        return -1;
+    }
+
+    long slots = header.file_sizes[DATA_ACCOUNTS] / sizeof(Account);
+    checkpoint_balances = malloc(sizeof(float) * (slots + 1));
+    int failed = get(in, checkpoint_balances, sizeof(float) * slots) < 0;
+    close(fd);
+    free(in);
+
+    if (failed)
+    {
+        // The trailer was intact, so this is a read error; nothing can be trusted
+        fprintf(stderr, "Failed to read %s\n", CHECKPOINT_FILE);
+        exit(EXIT_FAILURE);
+    }
+    loaded = header;
+    have_checkpoint = 1;
+    printf("Loaded checkpoint from %s", ctime(&header.taken));
+
+    // Replaying from before P is harmless: every record holds an absolute balance
+    long replay_from = 0;
+    SegmentInfo info;
+    for (; segments_info(postings_saved, &info) == 0 && info.sealed &&
+           info.base + info.count <= header.log_records && load_segment_postings(&info) == 0;
+         postings_saved++)
+        replay_from = info.base + info.count;
+    return replay_from;
+}
+
+// Adds records from record_no on to the posting index and brings every account
+// they touch to its newest logged balance; other accounts get their checkpointed
+// balance. accounts.dat is rewritten only where it differs.
+void replay_log(long record_no)
+{
+    int fd = data_fd(DATA_ACCOUNTS);
+    long slots = data_file_size(DATA_ACCOUNTS) / sizeof(Account);
+    float *latest = malloc(sizeof(float) * (slots + 1));
+    char *touched = calloc(slots + 1, 1);
+
+    long end = segments_record_count(), replayed = 0;
+    Transaction batch[CHECKPOINT_BATCH];
+    int count;
+    while (record_no < end && (count = segments_read(record_no, batch, CHECKPOINT_BATCH)) > 0)
+    {
+        for (int i = 0; i < count; i++, record_no++)
+        {
+            posting_append(&transaction_index, batch[i].accountID, record_no);
+            long offset = find_account_offset(fd, batch[i].accountID);
+            if (offset != -1 && offset / (long)sizeof(Account) < slots)
+            {
+                latest[offset / sizeof(Account)] = batch[i].newBalance;
+                touched[offset / sizeof(Account)] = 1;
+            }
+        }
+        replayed += count;
+    }
+
+    long checkpointed = have_checkpoint ? loaded.file_sizes[DATA_ACCOUNTS] / sizeof(Account) : 0;
+    int repaired = 0;
+    for (long slot = 0; slot < slots; slot++)
+    {
+        if (!touched[slot] && slot >= checkpointed)
+            continue;
+        Account acc;
+        if (pread(fd, &acc, sizeof(Account), slot * sizeof(Account)) != sizeof(Account))
+            continue;
+        float balance = touched[slot] ? latest[slot] : checkpoint_balances[slot];
+        if (balance == acc.balance)
+            continue;
+        acc.balance = balance;
+        if (pwrite(fd, &acc, sizeof(Account), slot * sizeof(Account)) == sizeof(Account))
+            repaired++;
+    }
+    printf("Replayed %ld transaction record(s), restored %d account balance(s).\n", replayed, repaired);
+
+    free(touched);
+    free(latest);
+    free(checkpoint_balances);
+    checkpoint_balances = NULL;
+}
@@ -0,0 +1,55 @@
+#include "../includes/server.h"
+
+// Runtime tunables, read once from the environment at startup
+ServerConfig server_config;
+
+static int env_int(const char *name, int default_value, int min_value)
+{
+    const char *value = getenv(name);
+    if (value == NULL || *value == '\0')
+        return default_value;
+
+    int parsed = atoi(value);
+    if (parsed < min_value)
+    {
+        fprintf(stderr, "Ignoring %s=%s (minimum is %d)\n", name, value, min_value);
+        return default_value;
+    }
+    return parsed;
+}
+
+void load_server_config()
+{
+    const char *io_model = getenv("BANK_IO_MODEL");
+    server_config.io_model = (io_model != NULL && strcmp(io_model, "epoll") == 0) ? IO_EPOLL : IO_THREADS;
+    server_config.worker_threads = env_int("BANK_WORKERS", DEFAULT_WORKER_THREADS, 1);
+    server_config.queue_capacity = env_int("BANK_QUEUE_SIZE", DEFAULT_QUEUE_CAPACITY, 1);
+    server_config.reactor_threads = env_int("BANK_REACTORS", DEFAULT_REACTOR_THREADS, 1);
+    server_config.session_stack_kb = env_int("BANK_SESSION_STACK_KB", DEFAULT_SESSION_STACK_KB, 32);
+    server_config.max_sessions = env_int("BANK_MAX_SESSIONS", DEFAULT_MAX_SESSIONS, 1);
+    server_config.lock_stripes = env_int("BANK_LOCK_STRIPES", DEFAULT_LOCK_STRIPES, 1);
+    server_config.fcntl_locks = env_int("BANK_FCNTL_LOCKS", 0, 0);
+    server_config.account_mmap = env_int("BANK_ACCOUNT_MMAP", 0, 0);
+    server_config.ledger_ring = env_int("BANK_LEDGER_RING", DEFAULT_LEDGER_RING, 2);
+    server_config.ledger_sync = env_int("BANK_LEDGER_SYNC", 0, 0);
+    server_config.ledger_segment = env_int("BANK_LEDGER_SEGMENT", DEFAULT_LEDGER_SEGMENT, 1);
+    server_config.engine = env_int("BANK_ENGINE", 0, 0);
+    server_config.engine_cpu = env_int("BANK_ENGINE_CPU", -1, 0);
+    server_config.checkpoint_seconds = env_int("BANK_CHECKPOINT_SECONDS", DEFAULT_CHECKPOINT_SECONDS, 0);
+
+    const char *account_sync = getenv("BANK_ACCOUNT_SYNC");
+    if (account_sync != NULL && strcmp(account_sync, "msync") == 0)
+        server_config.account_sync = ACCOUNT_SYNC_MSYNC;
+    else if (account_sync != NULL && strcmp(account_sync, "fdatasync") == 0)
+        server_config.account_sync = ACCOUNT_SYNC_FDATASYNC;
+    else
+        server_config.account_sync = ACCOUNT_SYNC_NONE;
+
+    const char *loan_assign = getenv("BANK_LOAN_ASSIGN");
+    if (loan_assign != NULL && strcmp(loan_assign, "least") == 0)
+        server_config.loan_assign = LOAN_ASSIGN_LEAST;
+    else if (loan_assign != NULL && strcmp(loan_assign, "round-robin") == 0)
+        server_config.loan_assign = LOAN_ASSIGN_ROUND_ROBIN;
+    else
+        server_config.loan_assign = LOAN_ASSIGN_MANUAL;
+}
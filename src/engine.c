@@ -0,0 +1,310 @@
+#include "../includes/server.h"
+
+// Single-writer account engine (BANK_ENGINE=1). Balance-changing commands are
+// queued on the ledger ring, whose ticket counter orders them; the ledger appender
+// thread applies each one to an in-memory copy of every account, with no account
+// locks, and journals the resulting absolute balances as transaction records in
+// the same write. Only after that write succeeds are the new values published to
+// readers (one seqlock per account) and written back to ACCOUNT_FILE; if it fails
+// they are rolled back. Balances lost from ACCOUNT_FILE in a crash are restored
+// from the log at startup (replay_log).
+
+#define ENGINE_CHUNK 4096  // account slots allocated together
+#define ENGINE_CHUNKS 4096 // up to 16M accounts
+
+typedef struct
+{
+    Account work; // engine thread only
+    int index;    // offset / sizeof(Account)
+    int dirty;    // changed in the batch being written
+    int loaded;   // set once work and view hold the record
+    unsigned seq; // odd while view is being replaced
+    Account view; // last journaled state, read by account_get
+} EngineSlot;
+
+static EngineSlot *chunks[ENGINE_CHUNKS];
+static int *dirty_slots;
+static int dirty_count;
+static int dirty_capacity;
+
+// Slot of the record at offset, loading it from ACCOUNT_FILE on first use
+static EngineSlot *slot_at(long offset)
+{
+    long slot = offset / sizeof(Account);
+    if (slot >= (long)ENGINE_CHUNK * ENGINE_CHUNKS)
+        return NULL;
+
+    EngineSlot *chunk = chunks[slot / ENGINE_CHUNK];
+    if (chunk == NULL)
+    {
+        chunk = calloc(ENGINE_CHUNK, sizeof(EngineSlot));
+        __atomic_store_n(&chunks[slot / ENGINE_CHUNK], chunk, __ATOMIC_RELEASE);
+    }
+    EngineSlot *s = &chunk[slot % ENGINE_CHUNK];
+    if (!s->loaded)
+    {
+        if (pread(data_fd(DATA_ACCOUNTS), &s->work, sizeof(Account), offset) != sizeof(Account))
+            return NULL;
+        s->view = s->work;
+        s->index = (int)slot;
+        __atomic_store_n(&s->loaded, 1, __ATOMIC_RELEASE);
+    }
+    return s;
+}
+
+static EngineSlot *slot_for(int account_no)
+{
+    long offset = find_account_offset(data_fd(DATA_ACCOUNTS), account_no);
+    return offset == -1 ? NULL : slot_at(offset);
+}
+
+static void mark_dirty(EngineSlot *s)
+{
+    if (s->dirty)
+        return;
+    s->dirty = 1;
+    if (dirty_count == dirty_capacity)
+    {
+        dirty_capacity = dirty_capacity ? dirty_capacity * 2 : 256;
+        dirty_slots = realloc(dirty_slots, sizeof(int) * dirty_capacity);
+    }
+    dirty_slots[dirty_count++] = s->index;
+}
+
+static void add_record(LedgerEntry *entry, int accountID, TransactionType type, float amount,
+                       float oldBalance, float newBalance)
+{
+    Transaction *t = &entry->records[entry->count++];
+    memset(t, 0, sizeof(*t));
+    t->accountID = accountID;
+    t->type = type;
+    t->amount = amount;
+    t->oldBalance = oldBalance;
+    t->newBalance = newBalance;
+}
+
+static void change_balance(EngineSlot *s, float delta)
+{
+    s->work.balance += delta;
+    mark_dirty(s);
+}
+
+// Same rules as the locked path in accounts.c; ops that failed validation there
+// arrive with a result other than ACC_OK and are skipped
+static void apply_op(LedgerEntry *entry, AccountOp *op)
+{
+    if (op->result != ACC_OK)
+        return;
+
+    EngineSlot *from = slot_for(op->account_no);
+    EngineSlot *to = (op->type == TRANSFER_SENT) ? slot_for(op->to_account) : NULL;
+    if (from == NULL || (op->type == TRANSFER_SENT && to == NULL))
+    {
+        op->result = ACC_NOT_FOUND;
+        return;
+    }
+
+    if (!from->work.is_active)
+    {
+        op->result = ACC_INACTIVE;
+        return;
+    }
+
+    float old_bal = from->work.balance;
+    if (op->type == DEPOSIT || op->type == LOAN_DEPOSIT)
+    {
+        change_balance(from, op->amount);
+        add_record(entry, op->account_no, op->type, op->amount, old_bal, from->work.balance);
+        entry->records[entry->count - 1].loanID = op->loan_id;
+    }
+    else if (op->type == WITHDRAWAL)
+    {
+        if (old_bal < op->amount)
+        {
+            op->result = ACC_INSUFFICIENT;
+            return;
+        }
+        change_balance(from, -op->amount);
+        add_record(entry, op->account_no, WITHDRAWAL, op->amount, old_bal, from->work.balance);
+    }
+    else
+    {
+        if (!to->work.is_active)
+            op->result = ACC_INACTIVE;
+        else if (old_bal < op->amount)
+            op->result = ACC_INSUFFICIENT;
+        if (op->result != ACC_OK)
+            return;
+
+        float to_old_bal = to->work.balance;
+        change_balance(from, -op->amount);
+        change_balance(to, op->amount);
+        add_record(entry, op->account_no, TRANSFER_SENT, op->amount, old_bal, from->work.balance);
+        add_record(entry, op->to_account, TRANSFER_RECEIVED, op->amount, to_old_bal, to->work.balance);
+    }
+    op->balance = from->work.balance;
+}
+
+// All or nothing: everything is checked against memory before anything changes
+static void apply_payout(EngineCommand *cmd)
+{
+    LedgerEntry *entry = &cmd->entry;
+    EngineSlot *from = slot_for(cmd->account_no);
+    cmd->failed_index = -1;
+    if (from == NULL)
+    {
+        cmd->result = ACC_NOT_FOUND;
+        return;
+    }
+
+    float total = 0;
+    cmd->result = ACC_OK;
+    for (int i = 0; i < cmd->count && cmd->result == ACC_OK; i++)
+    {
+        EngineSlot *to = slot_for(cmd->to_accounts[i]);
+        if (cmd->amounts[i] <= 0 || cmd->to_accounts[i] == cmd->account_no)
+            cmd->result = ACC_INVALID;
+        else if (to == NULL)
+            cmd->result = ACC_NOT_FOUND;
+        else if (!to->work.is_active)
+            cmd->result = ACC_INACTIVE;
+        if (cmd->result != ACC_OK)
+            cmd->failed_index = i;
+        total += cmd->amounts[i];
+    }
+    if (cmd->result == ACC_OK && !from->work.is_active)
+        cmd->result = ACC_INACTIVE;
+    if (cmd->result == ACC_OK && from->work.balance < total)
+        cmd->result = ACC_INSUFFICIENT;
+    if (cmd->result != ACC_OK)
+        return;
+
+    for (int i = 0; i < cmd->count; i++)
+    {
+        EngineSlot *to = slot_for(cmd->to_accounts[i]);
+        float from_old = from->work.balance, to_old = to->work.balance;
+        change_balance(from, -cmd->amounts[i]);
+        change_balance(to, cmd->amounts[i]);
+        add_record(entry, cmd->account_no, TRANSFER_SENT, cmd->amounts[i], from_old, from->work.balance);
+        add_record(entry, cmd->to_accounts[i], TRANSFER_RECEIVED, cmd->amounts[i], to_old, to->work.balance);
+    }
+}
+
+// Runs a command on the appender thread, filling its entry with the records to journal
+void engine_apply(EngineCommand *cmd)
+{
+    cmd->entry.count = 0;
+    if (cmd->type == ENGINE_APPLY)
+    {
+        for (int i = 0; i < cmd->count; i++)
+            apply_op(&cmd->entry, &cmd->ops[i]);
+    }
+    else if (cmd->type == ENGINE_PAYOUT)
+    {
+        apply_payout(cmd);
+    }
+    else
+    {
+        EngineSlot *s = slot_for(cmd->account_no);
+        cmd->result = (s == NULL) ? ACC_NOT_FOUND : ACC_OK;
+        if (s != NULL)
+        {
+            s->work.is_active = cmd->is_active;
+            mark_dirty(s);
+        }
+    }
+}
+
+// Publishes and writes back every account changed since the last call. Runs on
+// the appender thread once the batch's records are in the log.
+void engine_publish()
+{
+    int fd = data_fd(DATA_ACCOUNTS);
+    for (int i = 0; i < dirty_count; i++)
+    {
+        EngineSlot *s = &chunks[dirty_slots[i] / ENGINE_CHUNK][dirty_slots[i] % ENGINE_CHUNK];
+        unsigned seq = s->seq;
+        __atomic_store_n(&s->seq, seq + 1, __ATOMIC_RELAXED);
+        __atomic_thread_fence(__ATOMIC_RELEASE);
+        s->view = s->work;
+        __atomic_store_n(&s->seq, seq + 2, __ATOMIC_RELEASE);
+        s->dirty = 0;
+
+        // The log already holds this balance, so the write-back is not synced
+        if (pwrite(fd, &s->work, sizeof(Account), (long)dirty_slots[i] * sizeof(Account)) != sizeof(Account))
+            perror("Failed to write back account");
+    }
+    dirty_count = 0;
+}
+
+// Drops every change since the last call, for a batch whose records could not be
+// written: readers and ACCOUNT_FILE keep the last journaled state
+void engine_rollback()
+{
+    for (int i = 0; i < dirty_count; i++)
+    {
+        EngineSlot *s = &chunks[dirty_slots[i] / ENGINE_CHUNK][dirty_slots[i] % ENGINE_CHUNK];
+        s->work = s->view;
+        s->dirty = 0;
+    }
+    dirty_count = 0;
+}
+
+// Copies the published record at offset; returns ACC_OK, or -1 if the engine
+// has not loaded it yet (ACCOUNT_FILE is then current)
+int engine_read(long offset, Account *acc)
+{
+    long slot = offset / sizeof(Account);
+    if (slot >= (long)ENGINE_CHUNK * ENGINE_CHUNKS)
+        return -1;
+    EngineSlot *chunk = __atomic_load_n(&chunks[slot / ENGINE_CHUNK], __ATOMIC_ACQUIRE);
+    if (chunk == NULL)
+        return -1;
+    EngineSlot *s = &chunk[slot % ENGINE_CHUNK];
+    if (!__atomic_load_n(&s->loaded, __ATOMIC_ACQUIRE))
+        return -1;
+
+    unsigned before, after;
+    do
+    {
+        before = __atomic_load_n(&s->seq, __ATOMIC_ACQUIRE);
+        *acc = s->view;
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        after = __atomic_load_n(&s->seq, __ATOMIC_RELAXED);
+    } while ((before & 1) || before != after);
+    return ACC_OK;
+}
+
+// Queues a command behind every one submitted before it and waits until its
+// records are journaled; returns the ledger result (0 or -1). If the log write
+// failed the change was rolled back, and what had succeeded reports ACC_IO_ERROR.
+int engine_execute(EngineCommand *cmd)
+{
+    int capacity = (cmd->type == ENGINE_SET_ACTIVE) ? 0 : 2 * cmd->count;
+    Transaction *records = capacity <= 2 ? cmd->inline_records : malloc(sizeof(Transaction) * capacity);
+    ledger_submit_command(&cmd->entry, cmd, records);
+    int result = ledger_wait(&cmd->entry);
+    if (result < 0 && cmd->type == ENGINE_APPLY)
+    {
+        for (int i = 0; i < cmd->count; i++)
+            if (cmd->ops[i].result == ACC_OK)
+                cmd->ops[i].result = ACC_IO_ERROR;
+    }
+    else if (result < 0 && cmd->result == ACC_OK)
+    {
+        cmd->result = ACC_IO_ERROR;
+    }
+    if (records != cmd->inline_records)
+        free(records);
+    return result;
+}
+
+// Loads every account. Runs before the appender starts, once replay_log has
+// brought ACCOUNT_FILE up to date with the transaction log.
+void init_engine()
+{
+    long records = data_file_size(DATA_ACCOUNTS) / sizeof(Account);
+    for (long slot = 0; slot < records; slot++)
+        slot_at(slot * sizeof(Account));
+    printf("Engine mode: %ld accounts in memory.\n", records);
+}
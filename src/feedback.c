@@ -1,86 +1,385 @@
 #include "../includes/server.h"
+#include <ctype.h>
 
-void give_feedback(int accountId, const char *message)
+// feedback.dat: append-only FeedbackRecord headers, each followed by its message
+// Offsets and per-account / per-word record lists are kept in memory
+
+#define FEEDBACK_CHUNK 4096  // offsets allocated together
+#define FEEDBACK_CHUNKS 4096 // up to 16M records
+#define FEEDBACK_SCAN_BUFFER 65536
+#define FEEDBACK_PAGE_CHUNK 64 // record numbers fetched at a time while paging
+
+static long *feedback_offsets[FEEDBACK_CHUNKS];
+static int feedback_count; // offsets stored; published after the offset itself
+
+// Keyed by account number and by word hash (PostingList.account_no holds the key)
+static PostingIndex feedback_accounts;
+static PostingIndex feedback_words;
+
+// Keeps appends and their offsets in the same order
+static pthread_mutex_t feedback_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// Sequential, buffered reader over the records between two offsets
+typedef struct
+{
+    int fd;
+    long base;  // file offset of data[0]
+    long end;   // stop before this offset
+    size_t len; // bytes in data
+    size_t pos; // start of the next record in data
+    char data[FEEDBACK_SCAN_BUFFER];
+} FeedbackScan;
+
+// Caller holds feedback_lock, or runs at startup
+static void add_offset(long offset)
 {
-    int fd = open(FEEDBACK_FILE, O_RDWR | O_CREAT, 0666);
-    if (fd < 0)
+    int n = feedback_count;
+    if (feedback_offsets[n / FEEDBACK_CHUNK] == NULL)
+        feedback_offsets[n / FEEDBACK_CHUNK] = malloc(sizeof(long) * FEEDBACK_CHUNK);
+    feedback_offsets[n / FEEDBACK_CHUNK][n % FEEDBACK_CHUNK] = offset;
+    __atomic_store_n(&feedback_count, n + 1, __ATOMIC_RELEASE);
+}
+
+static long offset_at(long record_no)
+{
+    return feedback_offsets[record_no / FEEDBACK_CHUNK][record_no % FEEDBACK_CHUNK];
+}
+
+// Next run of letters and digits at *text, or NULL; moves *text past it
+static const char *next_word(const char **text, size_t *len)
+{
+    const char *p = *text;
+    while (*p && !isalnum((unsigned char)*p))
+        p++;
+    if (*p == '\0')
+        return NULL;
+    const char *start = p;
+    while (isalnum((unsigned char)*p))
+        p++;
+    *len = p - start;
+    *text = p;
+    return start;
+}
+
+// Case-insensitive FNV-1a, the key of a word in feedback_words
+static int word_hash(const char *word, size_t len)
+{
+    unsigned int h = 2166136261u;
+    for (size_t i = 0; i < len; i++)
+        h = (h ^ (unsigned char)tolower((unsigned char)word[i])) * 16777619u;
+    return (int)h;
+}
+
+static int compare_ints(const void *a, const void *b)
+{
+    int x = *(const int *)a, y = *(const int *)b;
+    return (x > y) - (x < y);
+}
+
+// Adds a record to the account and word indexes, each distinct word once
+static void index_feedback(long record_no, const FeedbackRecord *rec, const char *message)
+{
+    posting_append(&feedback_accounts, rec->accountID, record_no);
+
+    int hashes[FEEDBACK_MESSAGE_MAX / 2 + 1];
+    int count = 0;
+    size_t len;
+    const char *word;
+    while ((word = next_word(&message, &len)) != NULL)
+        hashes[count++] = word_hash(word, len);
+    qsort(hashes, count, sizeof(int), compare_ints);
+    for (int i = 0; i < count; i++)
+        if (i == 0 || hashes[i] != hashes[i - 1])
+            posting_append(&feedback_words, hashes[i], record_no);
+}
+
+// Check text has every keyword (word hashes can collide)
+static int has_keywords(const char *text, const char *keywords)
+{
+    size_t want_len, len;
+    const char *want;
+    while ((want = next_word(&keywords, &want_len)) != NULL)
     {
-        perror("Failed to open feedback file");
-        return;
+        const char *p = text, *word;
+        int found = 0;
+        while (!found && (word = next_word(&p, &len)) != NULL)
+            found = (len == want_len && strncasecmp(word, want, len) == 0);
+        if (!found)
+            return 0;
     }
+    return 1;
+}
+
+// Copies record record_no and its message (NUL-terminated); returns 0 or -1
+static int read_feedback(long record_no, FeedbackRecord *rec, char *message)
+{
+    int fd = data_fd(DATA_FEEDBACK);
+    int count = __atomic_load_n(&feedback_count, __ATOMIC_ACQUIRE);
+    if (record_no < 0 || record_no >= count)
+        return -1;
+
+    // The next offset bounds the record, so usually one read is enough
+    char record[sizeof(FeedbackRecord) + FEEDBACK_MESSAGE_MAX];
+    long offset = offset_at(record_no);
+    long size = record_no + 1 < count ? offset_at(record_no + 1) - offset : (long)sizeof(FeedbackRecord);
+    if (size < (long)sizeof(FeedbackRecord) || size > (long)sizeof(record) ||
+        pread(fd, record, size, offset) != size)
+        return -1;
+    memcpy(rec, record, sizeof(FeedbackRecord));
+    long total = sizeof(FeedbackRecord) + (long)rec->length;
+    if (rec->length < 0 || rec->length > FEEDBACK_MESSAGE_MAX ||
+        (total > size && pread(fd, record + size, total - size, offset + size) != total - size))
+        return -1;
+    memcpy(message, record + sizeof(FeedbackRecord), rec->length);
+    message[rec->length] = '\0';
+    return 0;
+}
+
+// Makes at least need bytes available from pos; returns 0 if the range ends first
+static int scan_fill(FeedbackScan *scan, size_t need)
+{
+    if (scan->len - scan->pos >= need)
+        return 1;
+    memmove(scan->data, scan->data + scan->pos, scan->len - scan->pos);
+    scan->base += scan->pos;
+    scan->len -= scan->pos;
+    scan->pos = 0;
+
+    long wanted = scan->end - (scan->base + (long)scan->len);
+    if (wanted > (long)(FEEDBACK_SCAN_BUFFER - scan->len))
+        wanted = FEEDBACK_SCAN_BUFFER - scan->len;
+    ssize_t got = wanted > 0 ? pread(scan->fd, scan->data + scan->len, wanted, scan->base + scan->len) : 0;
+    if (got > 0)
+        scan->len += got;
+    return scan->len >= need;
+}
 
-    struct flock lock;
-    memset(&lock, 0, sizeof(lock));
-    lock.l_type = F_WRLCK;
-    lock.l_whence = SEEK_SET;
-    lock.l_start = 0;
-    lock.l_len = 0;
+// Read the next record; returns its offset, -1 at the end or a torn record
+static long scan_next(FeedbackScan *scan, FeedbackRecord *rec, char *message)
+{
+    long offset = scan->base + (long)scan->pos;
+    if (!scan_fill(scan, sizeof(FeedbackRecord)))
+        return -1;
+    memcpy(rec, scan->data + scan->pos, sizeof(FeedbackRecord));
+    if (rec->length < 0 || rec->length > FEEDBACK_MESSAGE_MAX ||
+        !scan_fill(scan, sizeof(FeedbackRecord) + rec->length))
+        return -1;
+    memcpy(message, scan->data + scan->pos + sizeof(FeedbackRecord), rec->length);
+    message[rec->length] = '\0';
+    scan->pos += sizeof(FeedbackRecord) + rec->length;
+    return offset;
+}
+
+static FeedbackScan *scan_open(long from, long end)
+{
+    FeedbackScan *scan = calloc(1, sizeof(FeedbackScan));
+    scan->fd = data_fd(DATA_FEEDBACK);
+    scan->base = from;
+    scan->end = end;
+    return scan;
+}
 
-    if (fcntl(fd, F_SETLKW, &lock) == -1)
+// Create, convert or index feedback.dat at startup
+void init_feedback()
+{
+    int fd = data_fd(DATA_FEEDBACK);
+    long size = data_file_size(DATA_FEEDBACK);
+    int header[2] = {FEEDBACK_MAGIC, 0};
+    posting_init(&feedback_accounts);
+    posting_init(&feedback_words);
+    if (size == 0)
     {
-        perror("Failed to lock feedback file");
-        close(fd);
+        if (data_append(DATA_FEEDBACK, header, FEEDBACK_HEADER_SIZE) == -1)
+        {
+            perror("Failed to initialize feedback file");
+            exit(EXIT_FAILURE);
+        }
         return;
     }
+    if (size < (long)FEEDBACK_HEADER_SIZE || pread(fd, header, FEEDBACK_HEADER_SIZE, 0) != FEEDBACK_HEADER_SIZE ||
+        header[0] != FEEDBACK_MAGIC)
+    {
+        printf("Converting %s from the old fixed-size format.\n", FEEDBACK_FILE);
+        if (migrate_feedback_file(FEEDBACK_FILE) < 0)
+        {
+            fprintf(stderr, "Could not convert %s; run ./migrate_feedback with the server stopped\n", FEEDBACK_FILE);
+            exit(EXIT_FAILURE);
+        }
+        data_reopen(DATA_FEEDBACK);
+        fd = data_fd(DATA_FEEDBACK);
+        size = data_file_size(DATA_FEEDBACK);
+    }
 
-    Feedback fb;
-    fb.accountID = accountId;
-    memset(fb.message, 0, sizeof(fb.message));
-    if (message)
-        strncpy(fb.message, message, sizeof(fb.message) - 1);
+    FeedbackScan *scan = scan_open(FEEDBACK_HEADER_SIZE, size);
+    FeedbackRecord rec;
+    char message[FEEDBACK_MESSAGE_MAX + 1];
+    long offset, complete = FEEDBACK_HEADER_SIZE;
+    while (feedback_count < FEEDBACK_CHUNK * FEEDBACK_CHUNKS && (offset = scan_next(scan, &rec, message)) != -1)
+    {
+        index_feedback(feedback_count, &rec, message);
+        add_offset(offset);
+        complete = offset + sizeof(FeedbackRecord) + rec.length;
+    }
+    free(scan);
 
-    lseek(fd, 0, SEEK_END);
-    if (write(fd, &fb, sizeof(Feedback)) != sizeof(Feedback))
+    // Drop a partial record left by a crash mid-append
+    if (complete < size)
     {
-        perror("Failed to write feedback record");
+        printf("Dropping %ld byte(s) of incomplete feedback at the end of %s.\n", size - complete, FEEDBACK_FILE);
+        data_truncate(DATA_FEEDBACK, complete);
     }
+    printf("Feedback: %d record(s).\n", feedback_count);
+}
+
+void give_feedback(int accountId, const char *message)
+{
+    char record[sizeof(FeedbackRecord) + FEEDBACK_MESSAGE_MAX + 1];
+    FeedbackRecord rec;
+    memset(&rec, 0, sizeof(rec));
+    rec.length = message ? (int)strnlen(message, FEEDBACK_MESSAGE_MAX) : 0;
+    rec.accountID = accountId;
+    rec.timestamp = time(NULL);
+    memcpy(record, &rec, sizeof(rec));
+    if (rec.length > 0)
+        memcpy(record + sizeof(rec), message, rec.length);
 
-    lock.l_type = F_UNLCK;
-    fcntl(fd, F_SETLK, &lock);
-    close(fd);
+    pthread_mutex_lock(&feedback_lock);
+    long offset = -1;
+    if (feedback_count < FEEDBACK_CHUNK * FEEDBACK_CHUNKS)
+        offset = data_append(DATA_FEEDBACK, record, sizeof(rec) + rec.length);
+    if (offset != -1)
+    {
+        record[sizeof(rec) + rec.length] = '\0';
+        index_feedback(feedback_count, &rec, record + sizeof(rec));
+        add_offset(offset);
+    }
+    pthread_mutex_unlock(&feedback_lock);
+
+    if (offset == -1)
+    {
+        perror("Failed to write feedback record");
+    }
 }
 
-void view_feedbacks(int sock)
+// First position in the list whose record number is at least record_no
+static int position_of(PostingIndex *index, int key, int count, long record_no)
 {
-    int fd = open(FEEDBACK_FILE, O_RDONLY);
-    if (fd < 0)
+    int lo = 0, hi = count;
+    while (lo < hi)
     {
-        write_to_client(sock, "No feedbacks found or cannot open feedback file.\n");
-        return;
+        int mid = lo + (hi - lo) / 2;
+        long found;
+        if (posting_range(index, key, mid, 1, &found) == 1 && found < record_no)
+            lo = mid + 1;
+        else
+            hi = mid;
     }
+    return lo;
+}
 
-    struct flock lock;
-    memset(&lock, 0, sizeof(lock));
-    lock.l_type = F_RDLCK;
-    lock.l_start = 0;
-    lock.l_len = 0;
-    fcntl(fd, F_SETLKW, &lock);
-
-    Feedback fb;
-    char buffer[8192];
-    char line[2048];
-    int found = 0;
-    buffer[0] = '\0';
-    strcat(buffer, "\n--- Feedbacks ---\n");
-    strcat(buffer, "Account | Message\n");
-    strcat(buffer, "-------------------------------------------------------------\n");
-
-    while (read(fd, &fb, sizeof(Feedback)) == sizeof(Feedback))
+// Send one page of matching feedback; returns the last shown, -1 at the end
+long view_feedback_page(int sock, const FeedbackFilter *filter, int page_size, long cursor)
+{
+    const char *keywords = filter->keywords;
+    size_t len;
+    const char *first_word = next_word(&keywords, &len);
+
+    PostingIndex *index = NULL;
+    int key = 0;
+    if (first_word != NULL)
+    {
+        index = &feedback_words;
+        key = word_hash(first_word, len);
+    }
+    else if (filter->account_no != 0)
     {
-        found = 1;
-        snprintf(line, sizeof(line), "%-7d | %s\n", fb.accountID, fb.message);
-        if (strlen(buffer) + strlen(line) < sizeof(buffer) - 1)
-            strcat(buffer, line);
+        index = &feedback_accounts;
+        key = filter->account_no;
     }
+    int count = index ? posting_count(index, key) : __atomic_load_n(&feedback_count, __ATOMIC_ACQUIRE);
+    int pos = count - 1;
+    if (cursor >= 0)
+        pos = (index ? position_of(index, key, count, cursor) : (cursor < count ? (int)cursor : count)) - 1;
 
-    if (!found)
+    OutBuf *out = malloc(sizeof(OutBuf));
+    outbuf_init(out, sock);
+    outbuf_printf(out, "\n--- Feedbacks ---\n");
+    if (filter->account_no != 0)
+        outbuf_printf(out, "Account: %d\n", filter->account_no);
+    if (first_word != NULL)
+        outbuf_printf(out, "Keywords: %s\n", filter->keywords);
+    outbuf_printf(out, "Account | Date                | Message\n");
+    outbuf_printf(out, "-------------------------------------------------------------\n");
+
+    long records[FEEDBACK_PAGE_CHUNK];
+    long last = -1;
+    int shown = 0;
+    while (pos >= 0 && shown < page_size)
     {
-        strcat(buffer, "No feedbacks recorded.\n");
+        int first = pos - FEEDBACK_PAGE_CHUNK + 1 > 0 ? pos - FEEDBACK_PAGE_CHUNK + 1 : 0;
+        int fetched = pos - first + 1;
+        if (index)
+            fetched = posting_range(index, key, first, fetched, records);
+        else
+            for (int i = 0; i < fetched; i++)
+                records[i] = first + i;
+        if (fetched <= pos - first)
+            break;
+
+        for (int i = pos - first; i >= 0 && shown < page_size; i--, pos--)
+        {
+            FeedbackRecord rec;
+            char message[FEEDBACK_MESSAGE_MAX + 1];
+            if (read_feedback(records[i], &rec, message) < 0 ||
+                (filter->account_no != 0 && rec.accountID != filter->account_no) ||
+                !has_keywords(message, filter->keywords))
+                continue;
+
+            char date[32];
+            struct tm tm_buf;
+            if (rec.timestamp)
+                strftime(date, sizeof(date), "%Y-%m-%d %H:%M:%S", localtime_r(&rec.timestamp, &tm_buf));
+            else
+                strcpy(date, "-");
+            outbuf_printf(out, "%-7d | %-19s | %s\n", rec.accountID, date, message);
+            last = records[i];
+            shown++;
+        }
     }
 
-    lock.l_type = F_UNLCK;
-    fcntl(fd, F_SETLK, &lock);
-    close(fd);
+    if (shown == 0)
+        outbuf_printf(out, cursor >= 0 ? "No more feedback.\n"
+                           : (index || filter->account_no != 0) ? "No matching feedback.\n"
+                                                                : "No feedbacks recorded.\n");
+    outbuf_flush(out);
+    free(out);
+    return (pos >= 0 && shown > 0) ? last : -1;
+}
 
-    write_to_client(sock, buffer);
+// Menu view: newest first, one page at a time; filters restart from the newest
+void view_feedbacks(int sock)
+{
+    char buffer[512];
+    FeedbackFilter filter = {0, ""};
+    long cursor = view_feedback_page(sock, &filter, FEEDBACK_PAGE_SIZE, -1);
+    while (1)
+    {
+        write_to_client(sock, cursor != -1 ? "Enter n for older feedback, a <account> or k <keywords> to filter, anything else to go back: "
+                                           : "Enter a <account> or k <keywords> to filter (no value clears), anything else to go back: ");
+        if (read_from_client(sock, buffer, sizeof(buffer)) <= 0)
+            break;
+
+        if (strcmp(buffer, "n") == 0 && cursor != -1)
+        {
+            cursor = view_feedback_page(sock, &filter, FEEDBACK_PAGE_SIZE, cursor);
+            continue;
+        }
+        if ((buffer[0] != 'a' && buffer[0] != 'k') || (buffer[1] != ' ' && buffer[1] != '\0'))
+            break;
+        if (buffer[0] == 'a')
+            filter.account_no = atoi(buffer + 1);
+        else
+            snprintf(filter.keywords, sizeof(filter.keywords), "%s", buffer[1] ? buffer + 2 : "");
+        cursor = view_feedback_page(sock, &filter, FEEDBACK_PAGE_SIZE, -1);
+    }
 }
@@ -0,0 +1,75 @@
+#include "../includes/server.h"
+
+// Converts a feedback file from the old fixed-size Feedback records to the
+// length-prefixed format (see src/feedback.c), keeping the original as
+// <file>.old. Used by init_feedback and by ./migrate_feedback. Returns 1 once
+// converted, 0 if the file already has the new format, -1 on failure.
+int migrate_feedback_file(const char *path)
+{
+    char tmp_path[1024], old_path[1024];
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path);
+    snprintf(old_path, sizeof(old_path), "%s.old", path);
+
+    FILE *in = fopen(path, "rb");
+    if (in == NULL)
+    {
+        fprintf(stderr, "Cannot open %s: %s\n", path, strerror(errno));
+        return -1;
+    }
+
+    int magic = 0;
+    if (fread(&magic, sizeof(magic), 1, in) == 1 && magic == FEEDBACK_MAGIC)
+    {
+        printf("%s is already in the new format.\n", path);
+        fclose(in);
+        return 0;
+    }
+    rewind(in);
+
+    FILE *out = fopen(tmp_path, "wb");
+    if (out == NULL)
+    {
+        fprintf(stderr, "Cannot create %s: %s\n", tmp_path, strerror(errno));
+        fclose(in);
+        return -1;
+    }
+
+    int header[2] = {FEEDBACK_MAGIC, 0};
+    int failed = fwrite(header, FEEDBACK_HEADER_SIZE, 1, out) != 1;
+    long records = 0, old_bytes = 0, new_bytes = FEEDBACK_HEADER_SIZE;
+
+    Feedback fb;
+    while (!failed && fread(&fb, sizeof(Feedback), 1, in) == 1)
+    {
+        FeedbackRecord rec;
+        memset(&rec, 0, sizeof(rec));
+        rec.length = (int)strnlen(fb.message, FEEDBACK_MESSAGE_MAX);
+        rec.accountID = fb.accountID;
+        rec.timestamp = 0; // the old format has no time
+        failed = fwrite(&rec, sizeof(rec), 1, out) != 1 ||
+                 (rec.length > 0 && fwrite(fb.message, rec.length, 1, out) != 1);
+        records++;
+        old_bytes += sizeof(Feedback);
+        new_bytes += sizeof(rec) + rec.length;
+    }
+    if (!failed && ferror(in))
+        failed = 1;
+    if (!failed && ftell(in) > old_bytes)
+        fprintf(stderr, "Ignoring a partial record at the end of %s.\n", path);
+    fclose(in);
+
+    if (fflush(out) != 0 || fsync(fileno(out)) < 0)
+        failed = 1;
+    if (fclose(out) != 0)
+        failed = 1;
+    if (failed || rename(path, old_path) < 0 || rename(tmp_path, path) < 0)
+    {
+        fprintf(stderr, "Failed to convert %s: %s\n", path, strerror(errno));
+        unlink(tmp_path);
+        return -1;
+    }
+
+    printf("Converted %ld feedback record(s): %ld bytes -> %ld bytes. Original kept as %s.\n",
+           records, old_bytes, new_bytes, old_path);
+    return 1;
+}
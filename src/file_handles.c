@@ -0,0 +1,108 @@
+#include "../includes/server.h"
+#include <sys/stat.h>
+
+// One descriptor per data file, opened at startup and shared by every thread.
+// All access goes through pread/pwrite at explicit offsets, so no code depends on
+// a shared file position. Appends reserve their offset from an in-memory end of
+// file under a per-file mutex, which also serializes writers within the process.
+
+typedef struct
+{
+    const char *path;
+    int fd;
+    long end; // bytes of complete records; read with data_file_size
+    pthread_mutex_t append_lock;
+    OffsetIndex *index; // keyed by the int at the start of each record
+} DataHandle;
+
+static DataHandle handles[DATA_FILE_COUNT] = {
+    [DATA_USERS] = {USER_FILE, -1, 0, PTHREAD_MUTEX_INITIALIZER, &user_index},
+    [DATA_ACCOUNTS] = {ACCOUNT_FILE, -1, 0, PTHREAD_MUTEX_INITIALIZER, &account_index},
+    [DATA_LOANS] = {LOAN_FILE, -1, 0, PTHREAD_MUTEX_INITIALIZER, &loan_index},
+    [DATA_FEEDBACK] = {FEEDBACK_FILE, -1, 0, PTHREAD_MUTEX_INITIALIZER, NULL},
+};
+
+static void open_handle(DataHandle *handle)
+{
+    handle->fd = open(handle->path, O_RDWR | O_CREAT, 0666);
+    if (handle->fd < 0)
+    {
+        fprintf(stderr, "Failed to open %s: %s\n", handle->path, strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+    struct stat st;
+    fstat(handle->fd, &st);
+    handle->end = st.st_size;
+}
+
+void open_data_files()
+{
+    for (int i = 0; i < DATA_FILE_COUNT; i++)
+        open_handle(&handles[i]);
+}
+
+// Opens the file again after it was replaced on disk; startup only
+void data_reopen(DataFile file)
+{
+    close(handles[file].fd);
+    open_handle(&handles[file]);
+}
+
+int data_fd(DataFile file)
+{
+    return handles[file].fd;
+}
+
+long data_file_size(DataFile file)
+{
+    return __atomic_load_n(&handles[file].end, __ATOMIC_ACQUIRE);
+}
+
+// Caller holds the append lock
+static long append_locked(DataHandle *handle, const void *record, size_t size)
+{
+    long offset = handle->end;
+    ssize_t written = pwrite(handle->fd, record, size, offset);
+    if (written == (ssize_t)size && handle->index != NULL && handle->index->ready)
+    {
+        // Indexed before the record counts as appended, and in file order
+        int id;
+        memcpy(&id, record, sizeof(int));
+        index_insert(handle->index, id, offset);
+    }
+    if (written != (ssize_t)size)
+        return -1;
+    __atomic_store_n(&handle->end, offset + (long)size, __ATOMIC_RELEASE);
+    return offset;
+}
+
+// Writes size bytes at the end of the file; returns the record's offset or -1
+long data_append(DataFile file, const void *record, size_t size)
+{
+    DataHandle *handle = &handles[file];
+    pthread_mutex_lock(&handle->append_lock);
+    long offset = append_locked(handle, record, size);
+    pthread_mutex_unlock(&handle->append_lock);
+    return offset;
+}
+
+// Like data_append, but first stores the next ID of type in the record's leading
+// int. Both happen under the append lock, so IDs reach the file in increasing order.
+long data_append_new(DataFile file, void *record, size_t size, SequenceType type)
+{
+    DataHandle *handle = &handles[file];
+    pthread_mutex_lock(&handle->append_lock);
+    int id = (int)next_sequence_id(type);
+    memcpy(record, &id, sizeof(int));
+    long offset = append_locked(handle, record, size);
+    pthread_mutex_unlock(&handle->append_lock);
+    return offset;
+}
+
+// Drops a torn tail found by a startup scan, before any thread appends
+void data_truncate(DataFile file, long size)
+{
+    if (ftruncate(handles[file].fd, size) < 0)
+        perror("Failed to truncate data file");
+    __atomic_store_n(&handles[file].end, size, __ATOMIC_RELEASE);
+}
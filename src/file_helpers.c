@@ -2,10 +2,12 @@
 
 long find_user_offset(int fd, int userID)
 {
+    if (user_index.ready)
+        return index_lookup(&user_index, userID);
+
     User user;
     long offset = 0;
-    lseek(fd, 0, SEEK_SET);
-    while (read(fd, &user, sizeof(User)) == sizeof(User))
+    while (pread(fd, &user, sizeof(User), offset) == sizeof(User))
     {
         if (user.userID == userID)
             return offset;
@@ -16,10 +18,12 @@ long find_user_offset(int fd, int userID)
 
 long find_account_offset(int fd, int account_no)
 {
+    if (account_index.ready)
+        return index_lookup(&account_index, account_no);
+
     Account acc;
     long offset = 0;
-    lseek(fd, 0, SEEK_SET);
-    while (read(fd, &acc, sizeof(Account)) == sizeof(Account))
+    while (pread(fd, &acc, sizeof(Account), offset) == sizeof(Account))
     {
         if (acc.account_no == account_no)
             return offset;
@@ -30,10 +34,12 @@ long find_account_offset(int fd, int account_no)
 
 long find_loan_offset(int fd, int loan_id)
 {
+    if (loan_index.ready)
+        return index_lookup(&loan_index, loan_id);
+
     Loan loan;
     long offset = 0;
-    lseek(fd, 0, SEEK_SET);
-    while (read(fd, &loan, sizeof(Loan)) == sizeof(Loan))
+    while (pread(fd, &loan, sizeof(Loan), offset) == sizeof(Loan))
     {
         if (loan.loanID == loan_id)
             return offset;
@@ -44,78 +50,94 @@ long find_loan_offset(int fd, int loan_id)
 
 int get_next_user_id(int fd)
 {
+    if (user_index.ready)
+    {
+        long max_id = index_max_id(&user_index);
+        return (max_id > 1000 ? max_id : 1000) + 1;
+    }
+
     User user;
     int max_no = 1000;
-    lseek(fd, 0, SEEK_SET);
-    while (read(fd, &user, sizeof(User)) == sizeof(User))
+    long offset = 0;
+    while (pread(fd, &user, sizeof(User), offset) == sizeof(User))
     {
         if (user.userID > max_no)
             max_no = user.userID;
+        offset += sizeof(User);
     }
     return max_no + 1;
 }
 
 int get_next_account_no(int fd)
 {
+    if (account_index.ready)
+    {
+        long max_id = index_max_id(&account_index);
+        return (max_id > 5000 ? max_id : 5000) + 1;
+    }
+
     Account acc;
     int max_no = 5000; // customer account number starts from 5000
-    lseek(fd, 0, SEEK_SET);
-    while (read(fd, &acc, sizeof(Account)) == sizeof(Account))
+    long offset = 0;
+    while (pread(fd, &acc, sizeof(Account), offset) == sizeof(Account))
     {
         if (acc.account_no > max_no)
             max_no = acc.account_no;
+        offset += sizeof(Account);
     }
     return max_no + 1;
 }
 
 long get_next_loan_id(int fd)
 {
+    if (loan_index.ready)
+    {
+        long max_id = index_max_id(&loan_index);
+        return (max_id > 0 ? max_id : 0) + 1;
+    }
+
     Loan loan;
     long max_id = 0; // Start from 0, so first loan is 1
+    long offset = 0;
 
-    lseek(fd, 0, SEEK_SET); // moves to the start of the file
-
-    while (read(fd, &loan, sizeof(Loan)) == sizeof(Loan))
+    while (pread(fd, &loan, sizeof(Loan), offset) == sizeof(Loan))
     {
         if (loan.loanID > max_id)
         {
             max_id = loan.loanID;
         }
+        offset += sizeof(Loan);
     }
     return max_id + 1; // Return the next available ID
 }
 
-long get_next_transaction_id(int fd)
+void initialize_admin()
 {
-    Transaction trans;
-    long max_id = 0; // Start from 0, so first transaction is 1
-
-    lseek(fd, 0, SEEK_SET); // move to the start of the file
-
-    while (read(fd, &trans, sizeof(Transaction)) == sizeof(Transaction))
+    if (data_file_size(DATA_USERS) == 0)
     {
-        if (trans.transactionID > max_id)
+        User admin_user = {1000, "Admin User", "admin123", ADMIN, 1};
+        if (data_append(DATA_USERS, &admin_user, sizeof(User)) == -1)
         {
-            max_id = trans.transactionID;
+            perror("Failed to create default admin");
+            return;
         }
+        printf("Default admin user created. (User: 1000, Pass: admin123)\n");
     }
-    return max_id + 1;
 }
 
-void initialize_admin()
+// Appends a new active user; returns its userID or -1
+int user_create(const char *name, const char *password, Role role)
 {
-    int fd = open(USER_FILE, O_RDWR | O_CREAT, 0666);
-    if (fd < 0)
-    {
-        perror("Failed to open user file for init");
-        return;
-    }
+    User user;
+    memset(&user, 0, sizeof(user));
+    strncpy(user.name, name, sizeof(user.name) - 1);
+    strncpy(user.password, password, sizeof(user.password) - 1);
+    user.role = role;
+    user.is_active = 1; // Active by default
 
-    if (lseek(fd, 0, SEEK_END) == 0)
-    {
-        User admin_user = {1000, "Admin User", "admin123", ADMIN, 1};
-        write(fd, &admin_user, sizeof(User));
-        printf("Default admin user created. (User: 1000, Pass: admin123)\n");
-    }
-    close(fd);
+    if (data_append_new(DATA_USERS, &user, sizeof(User), SEQ_USER) == -1)
+        return -1;
+    if (role == EMPLOYEE)
+        loan_roster_update(user.userID, 1);
+    return user.userID;
 }
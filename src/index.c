@@ -0,0 +1,166 @@
+#include "../includes/server.h"
+
+// Process-wide ID -> file offset indexes, persisted as B+trees (src/btree.c)
+OffsetIndex user_index;
+OffsetIndex account_index;
+OffsetIndex loan_index;
+
+// Account number -> record numbers of its rows in the transaction log
+PostingIndex transaction_index;
+
+#define INDEX_INITIAL_CAPACITY 1024
+
+static unsigned int hash_id(int id)
+{
+    unsigned int h = (unsigned int)id;
+    h ^= h >> 16;
+    h *= 0x45d9f3b;
+    h ^= h >> 16;
+    return h;
+}
+
+// Caller must hold the write lock
+static void posting_grow(PostingIndex *index)
+{
+    int old_capacity = index->capacity;
+    PostingList *old_lists = index->lists;
+
+    index->capacity = old_capacity ? old_capacity * 2 : INDEX_INITIAL_CAPACITY;
+    index->lists = calloc(index->capacity, sizeof(PostingList));
+
+    for (int i = 0; i < old_capacity; i++)
+    {
+        if (old_lists[i].records == NULL)
+            continue;
+        unsigned int pos = hash_id(old_lists[i].account_no) & (index->capacity - 1);
+        while (index->lists[pos].records != NULL)
+            pos = (pos + 1) & (index->capacity - 1);
+        index->lists[pos] = old_lists[i];
+    }
+    free(old_lists);
+}
+
+// Caller must hold the lock; returns NULL when the account has no rows
+static PostingList *posting_find(PostingIndex *index, int account_no)
+{
+    unsigned int pos = hash_id(account_no) & (index->capacity - 1);
+    while (index->lists[pos].records != NULL)
+    {
+        if (index->lists[pos].account_no == account_no)
+            return &index->lists[pos];
+        pos = (pos + 1) & (index->capacity - 1);
+    }
+    return NULL;
+}
+
+void posting_init(PostingIndex *index)
+{
+    pthread_rwlock_init(&index->lock, NULL);
+    index->lists = NULL;
+    index->capacity = 0;
+    index->count = 0;
+    index->ready = 0;
+    posting_grow(index);
+}
+
+// Caller must hold the write lock; creates the list on first use
+static PostingList *posting_list_for(PostingIndex *index, int account_no)
+{
+    PostingList *list = posting_find(index, account_no);
+    if (list == NULL)
+    {
+        if ((index->count + 1) * 10 > index->capacity * 7)
+            posting_grow(index);
+        unsigned int pos = hash_id(account_no) & (index->capacity - 1);
+        while (index->lists[pos].records != NULL)
+            pos = (pos + 1) & (index->capacity - 1);
+        list = &index->lists[pos];
+        list->account_no = account_no;
+        list->capacity = 8;
+        list->count = 0;
+        list->records = malloc(sizeof(long) * list->capacity);
+        index->count++;
+    }
+    return list;
+}
+
+// Keeps each list in record order even if two writers finish out of order
+void posting_append(PostingIndex *index, int account_no, long record_no)
+{
+    pthread_rwlock_wrlock(&index->lock);
+    PostingList *list = posting_list_for(index, account_no);
+    if (list->count == list->capacity)
+    {
+        list->capacity *= 2;
+        list->records = realloc(list->records, sizeof(long) * list->capacity);
+    }
+
+    int pos = list->count;
+    while (pos > 0 && list->records[pos - 1] > record_no)
+    {
+        list->records[pos] = list->records[pos - 1];
+        pos--;
+    }
+    list->records[pos] = record_no;
+    list->count++;
+    pthread_rwlock_unlock(&index->lock);
+}
+
+// Appends count record numbers, all above the list's last one, under one lock
+void posting_extend(PostingIndex *index, int account_no, const long *records, int count)
+{
+    pthread_rwlock_wrlock(&index->lock);
+    PostingList *list = posting_list_for(index, account_no);
+    if (list->count + count > list->capacity)
+    {
+        while (list->count + count > list->capacity)
+            list->capacity *= 2;
+        list->records = realloc(list->records, sizeof(long) * list->capacity);
+    }
+    memcpy(list->records + list->count, records, sizeof(long) * count);
+    list->count += count;
+    pthread_rwlock_unlock(&index->lock);
+}
+
+int posting_count(PostingIndex *index, int account_no)
+{
+    pthread_rwlock_rdlock(&index->lock);
+    PostingList *list = posting_find(index, account_no);
+    int count = list ? list->count : 0;
+    pthread_rwlock_unlock(&index->lock);
+    return count;
+}
+
+// Copies up to count record numbers starting at position from; returns how many
+int posting_range(PostingIndex *index, int account_no, int from, int count, long *records)
+{
+    int copied = 0;
+    pthread_rwlock_rdlock(&index->lock);
+    PostingList *list = posting_find(index, account_no);
+    if (list != NULL && from >= 0 && from < list->count)
+    {
+        copied = list->count - from < count ? list->count - from : count;
+        memcpy(records, list->records + from, sizeof(long) * copied);
+    }
+    pthread_rwlock_unlock(&index->lock);
+    return copied;
+}
+
+// Opens the offset indexes, which catch up with records appended since they were
+// last written, then loads the latest checkpoint and replays the transaction log
+// from it on (src/checkpoint.c). Without a checkpoint the whole log is replayed.
+void build_indexes()
+{
+    index_open(&user_index, USER_INDEX_FILE, DATA_USERS, sizeof(User));
+    index_open(&account_index, ACCOUNT_INDEX_FILE, DATA_ACCOUNTS, sizeof(Account));
+    index_open(&loan_index, LOAN_INDEX_FILE, DATA_LOANS, sizeof(Loan));
+    posting_init(&transaction_index);
+
+    long replay_from = load_checkpoint();
+    if (replay_from < 0)
+        replay_from = 0;
+    replay_log(replay_from);
+    transaction_index.ready = 1;
+    printf("Indexed %d users, %d accounts, %d loans, transactions for %d accounts.\n",
+           user_index.count, account_index.count, loan_index.count, transaction_index.count);
+}
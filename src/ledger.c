@@ -0,0 +1,242 @@
+#define _GNU_SOURCE // pthread_setaffinity_np
+#include "../includes/server.h"
+#include <sched.h>
+#include <sys/uio.h>
+
+// Transaction log appender. Sessions push LedgerEntry pointers onto a bounded
+// lock-free MPSC ring (one ticket counter for producers, a sequence number per
+// cell). A single appender thread drains whatever is queued, stamps IDs and
+// timestamps in log order, writes the whole batch with one pwritev per log segment
+// it touches (src/segments.c) and, with BANK_LEDGER_SYNC=1, makes it durable with
+// one fdatasync (group commit). In engine mode the same thread is the
+// single writer for balances: it applies queued engine commands in ring order.
+
+#define LEDGER_BATCH_MAX 256
+
+typedef struct
+{
+    long sequence; // == position when free for that ticket, position + 1 when full
+    LedgerEntry *entry;
+} LedgerCell;
+
+static LedgerCell *ring;
+static long ring_mask;
+static long enqueue_pos;
+static long dequeue_pos; // only touched by the appender
+static long published_records; // log records whose batch is completely applied
+static time_t last_stamp; // only touched by the appender
+
+// The appender sleeps here when the ring is empty
+static pthread_mutex_t wake_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t wake_cond = PTHREAD_COND_INITIALIZER;
+static int appender_sleeping;
+
+// Submitters wait here for their batch to be written
+static pthread_mutex_t done_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t done_cond = PTHREAD_COND_INITIALIZER;
+
+static LedgerEntry *ring_pop()
+{
+    LedgerCell *cell = &ring[dequeue_pos & ring_mask];
+    if (__atomic_load_n(&cell->sequence, __ATOMIC_ACQUIRE) != dequeue_pos + 1)
+        return NULL;
+    LedgerEntry *entry = cell->entry;
+    __atomic_store_n(&cell->sequence, dequeue_pos + ring_mask + 1, __ATOMIC_RELEASE);
+    dequeue_pos++;
+    return entry;
+}
+
+static void wait_for_entries()
+{
+    pthread_mutex_lock(&wake_lock);
+    __atomic_store_n(&appender_sleeping, 1, __ATOMIC_SEQ_CST);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    LedgerCell *cell = &ring[dequeue_pos & ring_mask];
+    if (__atomic_load_n(&cell->sequence, __ATOMIC_ACQUIRE) != dequeue_pos + 1)
+        pthread_cond_wait(&wake_cond, &wake_lock);
+    __atomic_store_n(&appender_sleeping, 0, __ATOMIC_SEQ_CST);
+    pthread_mutex_unlock(&wake_lock);
+}
+
+static void write_batch(LedgerEntry **batch, int count)
+{
+    struct iovec iov[LEDGER_BATCH_MAX];
+    int records = 0, commands = 0;
+    for (int i = 0; i < count; i++)
+    {
+        if (batch[i]->command != NULL)
+        {
+            engine_apply(batch[i]->command);
+            commands++;
+        }
+        records += batch[i]->count;
+    }
+
+    long next_id = reserve_sequence_ids(SEQ_TRANSACTION, records);
+    // The wall clock can step back; the log (first_record_since, zone maps)
+    // relies on timestamps never decreasing
+    time_t now = time(NULL);
+    if (now < last_stamp)
+        now = last_stamp;
+    last_stamp = now;
+    for (int i = 0; i < count; i++)
+    {
+        for (int j = 0; j < batch[i]->count; j++)
+        {
+            batch[i]->records[j].transactionID = next_id++;
+            batch[i]->records[j].timestamp = now;
+        }
+        iov[i].iov_base = batch[i]->records;
+        iov[i].iov_len = sizeof(Transaction) * batch[i]->count;
+    }
+
+    long record_no = segments_append(iov, count);
+    int result = 0;
+    if (record_no == -1 || (server_config.ledger_sync && segments_sync() < 0))
+    {
+        perror("Failed to write transaction log");
+        result = -1;
+    }
+    if (record_no != -1)
+    {
+        for (int i = 0; i < count; i++)
+            for (int j = 0; j < batch[i]->count; j++)
+                posting_append(&transaction_index, batch[i]->records[j].accountID, record_no++);
+    }
+    // Balances the log does not hold are never published
+    if (commands > 0 && result == 0)
+        engine_publish();
+    else if (commands > 0)
+        engine_rollback();
+    __atomic_store_n(&published_records, segments_record_count(), __ATOMIC_RELEASE);
+
+    pthread_mutex_lock(&done_lock);
+    for (int i = 0; i < count; i++)
+    {
+        batch[i]->result = result;
+        batch[i]->done = 1;
+    }
+    pthread_cond_broadcast(&done_cond);
+    pthread_mutex_unlock(&done_lock);
+}
+
+static void *appender_main(void *arg)
+{
+    (void)arg;
+    if (server_config.engine_cpu >= 0)
+    {
+        cpu_set_t cpus;
+        CPU_ZERO(&cpus);
+        CPU_SET(server_config.engine_cpu, &cpus);
+        if (pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus) != 0)
+            fprintf(stderr, "Cannot pin ledger thread to CPU %d\n", server_config.engine_cpu);
+    }
+    LedgerEntry *batch[LEDGER_BATCH_MAX];
+    while (1)
+    {
+        int count = 0;
+        LedgerEntry *entry;
+        while (count < LEDGER_BATCH_MAX && (entry = ring_pop()) != NULL)
+            batch[count++] = entry;
+
+        if (count == 0)
+            wait_for_entries();
+        else
+            write_batch(batch, count);
+    }
+    return NULL;
+}
+
+void init_ledger(int capacity)
+{
+    long size = 1;
+    while (size < capacity)
+        size <<= 1;
+
+    ring = malloc(sizeof(LedgerCell) * size);
+    for (long i = 0; i < size; i++)
+        ring[i].sequence = i;
+    ring_mask = size - 1;
+    published_records = segments_record_count();
+    SegmentInfo info;
+    for (int i = 0; segments_info(i, &info) == 0; i++)
+        if (info.count > 0 && info.zone.max_time > last_stamp)
+            last_stamp = info.zone.max_time;
+
+    pthread_t thread;
+    if (pthread_create(&thread, NULL, appender_main, NULL) != 0)
+    {
+        perror("Failed to start ledger appender");
+        exit(EXIT_FAILURE);
+    }
+    pthread_detach(thread);
+}
+
+static void ring_push(LedgerEntry *entry)
+{
+    long pos = __atomic_fetch_add(&enqueue_pos, 1, __ATOMIC_RELAXED);
+    LedgerCell *cell = &ring[pos & ring_mask];
+    while (__atomic_load_n(&cell->sequence, __ATOMIC_ACQUIRE) != pos)
+        sched_yield(); // ring full: wait for the appender to free this cell
+    cell->entry = entry;
+    __atomic_store_n(&cell->sequence, pos + 1, __ATOMIC_RELEASE);
+
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&appender_sleeping, __ATOMIC_SEQ_CST))
+    {
+        pthread_mutex_lock(&wake_lock);
+        pthread_cond_signal(&wake_cond);
+        pthread_mutex_unlock(&wake_lock);
+    }
+}
+
+// Queues a record; the appender fills in its ID and timestamp. Safe to call while
+// holding account locks: records for one account reach the file in submit order.
+void ledger_submit(LedgerEntry *entry, int accountID, TransactionType type, float amount, float oldBalance, float newBalance)
+{
+    memset(entry, 0, sizeof(*entry));
+    entry->record.accountID = accountID;
+    entry->record.type = type;
+    entry->record.amount = amount;
+    entry->record.oldBalance = oldBalance;
+    entry->record.newBalance = newBalance;
+    entry->records = &entry->record;
+    entry->count = 1;
+    ring_push(entry);
+}
+
+// Queues count records that must land in the file together, in one write
+void ledger_submit_batch(LedgerEntry *entry, Transaction *records, int count)
+{
+    memset(entry, 0, sizeof(*entry));
+    entry->records = records;
+    entry->count = count;
+    ring_push(entry);
+}
+
+// Queues an engine command; the appender applies it and writes the records it
+// produces into records (room for two per op or payout)
+void ledger_submit_command(LedgerEntry *entry, struct EngineCommand *command, Transaction *records)
+{
+    memset(entry, 0, sizeof(*entry));
+    entry->command = command;
+    entry->records = records;
+    ring_push(entry);
+}
+
+// Every record below this number is in the log, and so is the account change
+// behind it (made before submitting, or by the engine before this is advanced)
+long ledger_published_records()
+{
+    return __atomic_load_n(&published_records, __ATOMIC_ACQUIRE);
+}
+
+// Blocks until the entry's batch is written (and synced); returns 0 or -1
+int ledger_wait(LedgerEntry *entry)
+{
+    pthread_mutex_lock(&done_lock);
+    while (!entry->done)
+        pthread_cond_wait(&done_cond, &done_lock);
+    pthread_mutex_unlock(&done_lock);
+    return entry->result;
+}
@@ -1,61 +1,487 @@
 #include "../includes/server.h"
 
-void view_pending_loans(int sock)
+// Lock-free loan reads (odd version = mid-write); writers take a stripe lock
+// Open loans are queued in memory by status and by employee
+
+#define LOAN_SLOT_CHUNK 4096  // slots allocated together
+#define LOAN_SLOT_CHUNKS 4096 // up to 16M loans
+#define LOAN_STRIPES 64
+#define LOAN_SCAN_BATCH 256
+
+enum
 {
-    int fd;
-    Loan loan;
-    char buffer[4096] = {0};
-    char temp_line[256];
-    int found_loans = 0;
+    STATUS_LINK,  // the PENDING or ASSIGNED queue
+    EMPLOYEE_LINK // the assigned employee's queue
+};
+
+typedef struct
+{
+    unsigned version; // odd while a writer is replacing the record
+    int queued;       // status whose queues hold the slot, 0 for none
+    int employee_id;  // employee queue holding the slot
+    int prev[2];      // neighbouring slots in each queue, -1 at the ends
+    int next[2];
+} LoanSlot;
+
+typedef struct
+{
+    int head; // oldest slot, -1 when empty
+    int tail;
+    int count;
+} LoanQueue;
+
+typedef struct
+{
+    int employee_id; // 0 marks an empty entry
+    LoanQueue queue;
+} EmployeeQueue;
+
+static LoanSlot *loan_slots[LOAN_SLOT_CHUNKS];
+static pthread_mutex_t loan_stripes[LOAN_STRIPES];
+static pthread_once_t loan_stripes_once = PTHREAD_ONCE_INIT;
+
+// Guards every queue and the link fields of every slot
+static pthread_mutex_t queue_lock = PTHREAD_MUTEX_INITIALIZER;
+static LoanQueue pending_queue = {-1, -1, 0};
+static LoanQueue assigned_queue = {-1, -1, 0};
+static EmployeeQueue *employee_queues; // open addressing by employee_id
+static int employee_capacity;
+static int employee_count;
+
+// Employees considered by BANK_LOAN_ASSIGN, also under queue_lock
+typedef struct
+{
+    int employee_id;
+    int eligible; // active when last seen
+} RosterEntry;
+
+static RosterEntry *roster;
+static int roster_count;
+static int roster_capacity;
+static int roster_next; // round-robin position
+
+static void init_loan_stripes()
+{
+    for (int i = 0; i < LOAN_STRIPES; i++)
+        pthread_mutex_init(&loan_stripes[i], NULL);
+}
+
+static LoanSlot *loan_slot(long slot)
+{
+    if (slot >= (long)LOAN_SLOT_CHUNK * LOAN_SLOT_CHUNKS)
+        return NULL;
+
+    LoanSlot **chunk_ref = &loan_slots[slot / LOAN_SLOT_CHUNK];
+    LoanSlot *chunk = __atomic_load_n(chunk_ref, __ATOMIC_ACQUIRE);
+    if (chunk == NULL)
+    {
+        LoanSlot *fresh = calloc(LOAN_SLOT_CHUNK, sizeof(LoanSlot));
+        if (__atomic_compare_exchange_n(chunk_ref, &chunk, fresh, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+            chunk = fresh;
+        else
+            free(fresh);
+    }
+    return &chunk[slot % LOAN_SLOT_CHUNK];
+}
+
+static unsigned *loan_version(long offset)
+{
+    LoanSlot *slot = loan_slot(offset / sizeof(Loan));
+    return slot ? &slot->version : NULL;
+}
+
+static void lock_loan(long offset)
+{
+    pthread_once(&loan_stripes_once, init_loan_stripes);
+    pthread_mutex_lock(&loan_stripes[(offset / sizeof(Loan)) % LOAN_STRIPES]);
+}
+
+static void unlock_loan(long offset)
+{
+    pthread_mutex_unlock(&loan_stripes[(offset / sizeof(Loan)) % LOAN_STRIPES]);
+}
+
+// Copies a consistent version of the loan at offset; returns 0, or -1 past EOF
+static int loan_read(int fd, Loan *loan, long offset)
+{
+    unsigned *version = loan_version(offset);
+    unsigned before, after;
+    do
+    {
+        before = version ? __atomic_load_n(version, __ATOMIC_ACQUIRE) : 0;
+        if (pread(fd, loan, sizeof(Loan), offset) != sizeof(Loan))
+            return -1;
+        after = version ? __atomic_load_n(version, __ATOMIC_ACQUIRE) : 0;
+    } while ((before & 1) || before != after);
+    return 0;
+}
 
-    fd = open(LOAN_FILE, O_RDONLY);
-    if (fd == -1)
+// Replaces the loan at offset; the caller holds lock_loan(offset)
+static int loan_write(int fd, const Loan *loan, long offset)
+{
+    unsigned *version = loan_version(offset);
+    if (version)
+        __atomic_add_fetch(version, 1, __ATOMIC_ACQ_REL);
+    ssize_t written = pwrite(fd, loan, sizeof(Loan), offset);
+    if (version)
+        __atomic_add_fetch(version, 1, __ATOMIC_RELEASE);
+    return written == sizeof(Loan) ? 0 : -1;
+}
+
+// Caller holds queue_lock. capacity is always a power of two.
+static LoanQueue *employee_queue(int employee_id, int create)
+{
+    if (create && (employee_count + 1) * 10 > employee_capacity * 7)
     {
-        perror("Error opening loan file");
-        write_to_client(sock, "Error: Could not access loan data.\n");
+        EmployeeQueue *old = employee_queues;
+        int old_capacity = employee_capacity;
+        employee_capacity = old_capacity ? old_capacity * 2 : 64;
+        employee_queues = calloc(employee_capacity, sizeof(EmployeeQueue));
+        for (int i = 0; i < old_capacity; i++)
+        {
+            if (old[i].employee_id == 0)
+                continue;
+            unsigned pos = ((unsigned)old[i].employee_id * 2654435761u) & (employee_capacity - 1);
+            while (employee_queues[pos].employee_id != 0)
+                pos = (pos + 1) & (employee_capacity - 1);
+            employee_queues[pos] = old[i];
+        }
+        free(old);
+    }
+    if (employee_capacity == 0)
+        return NULL;
+
+    unsigned pos = ((unsigned)employee_id * 2654435761u) & (employee_capacity - 1);
+    while (employee_queues[pos].employee_id != 0)
+    {
+        if (employee_queues[pos].employee_id == employee_id)
+            return &employee_queues[pos].queue;
+        pos = (pos + 1) & (employee_capacity - 1);
+    }
+    if (!create)
+        return NULL;
+    employee_queues[pos].employee_id = employee_id;
+    employee_queues[pos].queue = (LoanQueue){-1, -1, 0};
+    employee_count++;
+    return &employee_queues[pos].queue;
+}
+
+// Caller holds queue_lock
+static void queue_push(LoanQueue *queue, int link, int slot)
+{
+    LoanSlot *s = loan_slot(slot);
+    s->prev[link] = queue->tail;
+    s->next[link] = -1;
+    if (queue->tail == -1)
+        queue->head = slot;
+    else
+        loan_slot(queue->tail)->next[link] = slot;
+    queue->tail = slot;
+    queue->count++;
+}
+
+// Caller holds queue_lock
+static void queue_remove(LoanQueue *queue, int link, int slot)
+{
+    LoanSlot *s = loan_slot(slot);
+    if (s->prev[link] == -1)
+        queue->head = s->next[link];
+    else
+        loan_slot(s->prev[link])->next[link] = s->next[link];
+    if (s->next[link] == -1)
+        queue->tail = s->prev[link];
+    else
+        loan_slot(s->next[link])->prev[link] = s->prev[link];
+    queue->count--;
+}
+
+// Requeue a loan by its record on disk; caller holds lock_loan(offset)
+static void track_loan(int fd, long offset)
+{
+    Loan loan;
+    int slot = (int)(offset / sizeof(Loan));
+    LoanSlot *s = loan_slot(slot);
+    if (s == NULL || loan_read(fd, &loan, offset) < 0)
         return;
+
+    pthread_mutex_lock(&queue_lock);
+    if (s->queued == PENDING)
+        queue_remove(&pending_queue, STATUS_LINK, slot);
+    else if (s->queued == ASSIGNED)
+    {
+        queue_remove(&assigned_queue, STATUS_LINK, slot);
+        queue_remove(employee_queue(s->employee_id, 0), EMPLOYEE_LINK, slot);
     }
 
-    struct flock lock;
-    memset(&lock, 0, sizeof(lock));
-    lock.l_type = F_RDLCK;
-    lock.l_whence = SEEK_SET;
-    lock.l_start = 0;
-    lock.l_len = 0;
-    fcntl(fd, F_SETLKW, &lock);
+    s->queued = (loan.status == PENDING || loan.status == ASSIGNED) ? loan.status : 0;
+    if (s->queued == PENDING)
+        queue_push(&pending_queue, STATUS_LINK, slot);
+    else if (s->queued == ASSIGNED)
+    {
+        s->employee_id = loan.assignedEmployeeID;
+        queue_push(&assigned_queue, STATUS_LINK, slot);
+        queue_push(employee_queue(s->employee_id, 1), EMPLOYEE_LINK, slot);
+    }
+    pthread_mutex_unlock(&queue_lock);
+}
 
-    strcat(buffer, "\n--- Loan Status Overview ---\n");
-    strcat(buffer, "ID  | Customer | Amount   | Status      | Assigned To\n");
-    strcat(buffer, "-------------------------------------------------------\n");
+// Copy a queue's slots, oldest first; caller holds queue_lock
+static int *queue_slots(const LoanQueue *queue, int link, int *count)
+{
+    int *slots = malloc(sizeof(int) * (queue ? queue->count + 1 : 1));
+    *count = 0;
+    for (int slot = queue ? queue->head : -1; slot != -1; slot = loan_slot(slot)->next[link])
+        slots[(*count)++] = slot;
+    return slots;
+}
 
-    while (read(fd, &loan, sizeof(Loan)) == sizeof(Loan))
+// Check whether a DISBURSING loan's deposit is in the log
+static int loan_disbursed(const Loan *loan)
+{
+    long record_nos[LOAN_SCAN_BATCH];
+    int end = posting_count(&transaction_index, loan->customerUserID);
+    while (end > 0)
     {
-        if (loan.status == PENDING || loan.status == ASSIGNED)
+        int from = end > LOAN_SCAN_BATCH ? end - LOAN_SCAN_BATCH : 0;
+        int found = posting_range(&transaction_index, loan->customerUserID, from, end - from, record_nos);
+        for (int i = found - 1; i >= 0; i--)
         {
-            const char* status_str = 
-                (loan.status == PENDING) ? "PENDING" :
-                (loan.status == ASSIGNED) ? "ASSIGNED" : "UNKNOWN";
-            
-            sprintf(temp_line, "%-3d | %-8d | %-9.2f | %-11s | %-d\n",
-                    loan.loanID,
-                    loan.customerUserID,
-                    loan.amount,
-                    status_str,
-                    loan.assignedEmployeeID);
-            strcat(buffer, temp_line);
-            found_loans = 1;
+            Transaction t;
+            if (segments_read(record_nos[i], &t, 1) == 1 && t.type == LOAN_DEPOSIT && t.loanID == loan->loanID)
+                return 1;
         }
+        end = from;
+    }
+    return 0;
+}
+
+// Queue open loans and settle DISBURSING ones at startup
+void init_loan_queues()
+{
+    int fd = data_fd(DATA_LOANS);
+    long end = data_file_size(DATA_LOANS);
+    Loan batch[LOAN_SCAN_BATCH];
+    for (long offset = 0; offset < end;)
+    {
+        ssize_t bytes = pread(fd, batch, sizeof(batch), offset);
+        if (bytes < (ssize_t)sizeof(Loan))
+            break;
+        for (ssize_t i = 0; i < bytes / (ssize_t)sizeof(Loan) && offset < end; i++, offset += sizeof(Loan))
+        {
+            if (batch[i].status == DISBURSING)
+            {
+                batch[i].status = loan_disbursed(&batch[i]) ? APPROVED : ASSIGNED;
+                if (loan_write(fd, &batch[i], offset) < 0)
+                    perror("Failed to settle loan");
+                printf("Loan %d was being disbursed: marked %s.\n", batch[i].loanID,
+                       batch[i].status == APPROVED ? "APPROVED" : "ASSIGNED");
+            }
+            if (batch[i].status == PENDING || batch[i].status == ASSIGNED)
+                track_loan(fd, offset);
+        }
+    }
+    printf("Loan queues: %d pending, %d assigned.\n", pending_queue.count, assigned_queue.count);
+}
+
+void view_pending_loans(int sock)
+{
+    int fd = data_fd(DATA_LOANS);
+    int pending_count, assigned_count;
+    pthread_mutex_lock(&queue_lock);
+    int *pending = queue_slots(&pending_queue, STATUS_LINK, &pending_count);
+    int *assigned = queue_slots(&assigned_queue, STATUS_LINK, &assigned_count);
+    pthread_mutex_unlock(&queue_lock);
+
+    OutBuf out;
+    outbuf_init(&out, sock);
+    outbuf_printf(&out, "\n--- Loan Status Overview ---\n");
+    outbuf_printf(&out, "ID  | Customer | Amount   | Status      | Assigned To\n");
+    outbuf_printf(&out, "-------------------------------------------------------\n");
+
+    // A loan that changed after the copy is shown as it is now, if still open
+    int found_loans = 0;
+    for (int i = 0; i < pending_count + assigned_count; i++)
+    {
+        Loan loan;
+        int slot = i < pending_count ? pending[i] : assigned[i - pending_count];
+        if (loan_read(fd, &loan, (long)slot * sizeof(Loan)) < 0 ||
+            loan.status != (i < pending_count ? PENDING : ASSIGNED))
+            continue;
+        outbuf_printf(&out, "%-3d | %-8d | %-9.2f | %-11s | %-d\n",
+                      loan.loanID,
+                      loan.customerUserID,
+                      loan.amount,
+                      loan.status == PENDING ? "PENDING" : "ASSIGNED",
+                      loan.assignedEmployeeID);
+        found_loans = 1;
     }
     if (!found_loans)
     {
-        strcat(buffer, "No pending or assigned loans found.\n");
+        outbuf_printf(&out, "No pending or assigned loans found.\n");
     }
+    outbuf_flush(&out);
+    free(assigned);
+    free(pending);
+}
 
-    lock.l_type = F_UNLCK;
-    fcntl(fd, F_SETLK, &lock);
-    close(fd);
+// Why emp_id cannot take loans, or NULL if it can
+static const char *employee_error(int emp_id)
+{
+    int user_fd = data_fd(DATA_USERS);
+    long emp_offset = find_user_offset(user_fd, emp_id);
+    if (emp_offset == -1)
+        return "Error: Employee ID not found.\n";
 
-    write_to_client(sock, buffer);
+    User emp_user;
+    if (pread(user_fd, &emp_user, sizeof(User), emp_offset) != sizeof(User))
+        return "Error: Cannot verify employee ID.\n";
+    if (emp_user.role != EMPLOYEE)
+        return "Error: Specified ID is not an employee.\n";
+    if (!emp_user.is_active)
+        return "Error: This employee account is deactivated.\n";
+    return NULL;
+}
+
+// Assigns the loan at offset if it is still PENDING; returns 0 if it was
+static int assign_to(long offset, int emp_id)
+{
+    int fd = data_fd(DATA_LOANS);
+    Loan loan;
+    int result = -1;
+    lock_loan(offset);
+    if (loan_read(fd, &loan, offset) == 0 && loan.status == PENDING)
+    {
+        loan.status = ASSIGNED;
+        loan.assignedEmployeeID = emp_id;
+        if (loan_write(fd, &loan, offset) == 0)
+            result = 0;
+    }
+    track_loan(fd, offset);
+    unlock_loan(offset);
+    return result;
+}
+
+// Pick an eligible employee by policy, 0 if none; caller holds queue_lock
+static int pick_employee()
+{
+    int best = -1, best_depth = 0;
+    for (int i = 0; i < roster_count; i++)
+    {
+        int pos = (roster_next + i) % roster_count;
+        if (!roster[pos].eligible)
+            continue;
+        if (server_config.loan_assign == LOAN_ASSIGN_ROUND_ROBIN)
+        {
+            best = pos;
+            break;
+        }
+        LoanQueue *queue = employee_queue(roster[pos].employee_id, 0);
+        int depth = queue ? queue->count : 0;
+        if (best == -1 || depth < best_depth)
+        {
+            best = pos;
+            best_depth = depth;
+        }
+    }
+    if (best == -1)
+        return 0;
+    roster_next = (best + 1) % roster_count;
+    return roster[best].employee_id;
+}
+
+// Add or update a roster entry, then hand out any backlog
+void loan_roster_update(int employee_id, int eligible)
+{
+    if (server_config.loan_assign == LOAN_ASSIGN_MANUAL)
+        return;
+
+    pthread_mutex_lock(&queue_lock);
+    int pos = 0;
+    while (pos < roster_count && roster[pos].employee_id != employee_id)
+        pos++;
+    if (pos == roster_count)
+    {
+        if (roster_count == roster_capacity)
+        {
+            roster_capacity = roster_capacity ? roster_capacity * 2 : 16;
+            roster = realloc(roster, sizeof(RosterEntry) * roster_capacity);
+        }
+        roster[roster_count++].employee_id = employee_id;
+    }
+    roster[pos].eligible = eligible;
+    pthread_mutex_unlock(&queue_lock);
+
+    if (eligible)
+        auto_assign_loans();
+}
+
+// Assign PENDING loans, oldest first, while an employee can take one
+void auto_assign_loans()
+{
+    if (server_config.loan_assign == LOAN_ASSIGN_MANUAL)
+        return;
+
+    pthread_mutex_lock(&queue_lock);
+    int attempts = pending_queue.count;
+    pthread_mutex_unlock(&queue_lock);
+
+    while (attempts-- > 0)
+    {
+        pthread_mutex_lock(&queue_lock);
+        int slot = pending_queue.head;
+        int emp_id = slot == -1 ? 0 : pick_employee();
+        pthread_mutex_unlock(&queue_lock);
+        if (emp_id == 0)
+            break;
+
+        if (employee_error(emp_id) != NULL)
+        {
+            pthread_mutex_lock(&queue_lock);
+            for (int i = 0; i < roster_count; i++)
+                if (roster[i].employee_id == emp_id)
+                    roster[i].eligible = 0;
+            pthread_mutex_unlock(&queue_lock);
+            attempts++;
+            continue;
+        }
+        // Skip loans another session took first
+        assign_to((long)slot * sizeof(Loan), emp_id);
+    }
+}
+
+// Loads the EMPLOYEE users into the roster and assigns the PENDING backlog
+void init_loan_assignment()
+{
+    if (server_config.loan_assign == LOAN_ASSIGN_MANUAL)
+        return;
+
+    int fd = data_fd(DATA_USERS);
+    long end = data_file_size(DATA_USERS);
+    User batch[LOAN_SCAN_BATCH];
+    for (long offset = 0; offset < end;)
+    {
+        ssize_t bytes = pread(fd, batch, sizeof(batch), offset);
+        if (bytes < (ssize_t)sizeof(User))
+            break;
+        for (ssize_t i = 0; i < bytes / (ssize_t)sizeof(User) && offset < end; i++, offset += sizeof(User))
+        {
+            // Duplicate records are ignored like the index ignores them
+            if (batch[i].role == EMPLOYEE && find_user_offset(fd, batch[i].userID) == offset)
+            {
+                if (roster_count == roster_capacity)
+                {
+                    roster_capacity = roster_capacity ? roster_capacity * 2 : 16;
+                    roster = realloc(roster, sizeof(RosterEntry) * roster_capacity);
+                }
+                roster[roster_count].employee_id = batch[i].userID;
+                roster[roster_count++].eligible = batch[i].is_active;
+            }
+        }
+    }
+    auto_assign_loans();
+    printf("Loan auto-assignment (%s): %d employee(s), %d loan(s) pending.\n",
+           server_config.loan_assign == LOAN_ASSIGN_LEAST ? "least" : "round-robin",
+           roster_count, pending_queue.count);
 }
 
 void assign_loan(int sock)
@@ -67,94 +493,202 @@ void assign_loan(int sock)
     char buffer[1024];
 
     write_to_client(sock, "Enter Loan ID to assign to employee: ");
-    read_from_client(sock, buffer, sizeof(buffer));
+    if (read_from_client(sock, buffer, sizeof(buffer)) <= 0)
+        return;
     loan_id_to_assign = atoi(buffer);
 
     write_to_client(sock, "Enter Employee ID to assign this loan to: ");
-    read_from_client(sock, buffer, sizeof(buffer));
+    if (read_from_client(sock, buffer, sizeof(buffer)) <= 0)
+        return;
     emp_id = atoi(buffer);
 
     // Verify employee exists and is actually an employee
-    int user_fd = open(USER_FILE, O_RDONLY);
-    if (user_fd < 0) {
-        write_to_client(sock, "Error: Cannot verify employee ID.\n");
+    const char *error = employee_error(emp_id);
+    if (error != NULL) {
+        write_to_client(sock, error);
         return;
     }
 
-    long emp_offset = find_user_offset(user_fd, emp_id);
-    if (emp_offset == -1) {
-        write_to_client(sock, "Error: Employee ID not found.\n");
-        close(user_fd);
-        return;
-    }
-
-    User emp_user;
-    lseek(user_fd, emp_offset, SEEK_SET);
-    read(user_fd, &emp_user, sizeof(User));
-    close(user_fd);
-
-    if (emp_user.role != EMPLOYEE) {
-        write_to_client(sock, "Error: Specified ID is not an employee.\n");
-        return;
-    }
-    if (!emp_user.is_active) {
-        write_to_client(sock, "Error: This employee account is deactivated.\n");
+    fd = data_fd(DATA_LOANS);
+    long offset = find_loan_offset(fd, loan_id_to_assign);
+    if (offset == -1)
+    {
+        write_to_client(sock, "Error: Loan ID not found.\n");
         return;
     }
 
-    fd = open(LOAN_FILE, O_RDWR);
-    if (fd == -1)
+    // Update the record under the stripe lock, reply after
+    const char *reply;
+    lock_loan(offset);
+    if (loan_read(fd, &loan, offset) < 0)
+        reply = "Error: Could not access loan data.\n";
+    else if (loan.status == PROCESSING)
+        reply = "Error: Can only assign PENDING loans.\n";
+    else if (loan.status != PENDING)
+        reply = "Error: This loan is not pending or processing.\n";
+    else
     {
-        perror("Error opening loan file");
-        write_to_client(sock, "Error: Could not access loan data.\n");
-        return;
+        loan.status = ASSIGNED;
+        loan.assignedEmployeeID = emp_id;
+        if (loan_write(fd, &loan, offset) < 0)
+            reply = "Error: Failed to update loan record.\n";
+        else
+            reply = "Loan assigned successfully.\n";
+        track_loan(fd, offset);
     }
+    unlock_loan(offset);
+    write_to_client(sock, reply);
+}
 
-    long offset = find_loan_offset(fd, loan_id_to_assign);
+typedef struct
+{
+    long offset;
+    int decision; // index into the caller's decisions
+} ReviewTarget;
 
-    if (offset != -1)
+static int compare_review_targets(const void *a, const void *b)
+{
+    const ReviewTarget *x = a, *y = b;
+    if (x->offset != y->offset)
+        return (x->offset > y->offset) - (x->offset < y->offset);
+    return x->decision - y->decision;
+}
+
+// Apply an employee's decisions; approvals are DISBURSING until paid
+int loan_review_batch(int emp_id, LoanDecision *decisions, int count)
+{
+    int fd = data_fd(DATA_LOANS);
+    ReviewTarget *targets = malloc(sizeof(ReviewTarget) * (count + 1));
+    int valid = 0;
+    for (int i = 0; i < count; i++)
     {
-        struct flock lock;
-        memset(&lock, 0, sizeof(lock));
-        lock.l_type = F_WRLCK;
-        lock.l_whence = SEEK_SET;
-        lock.l_start = offset;
-        lock.l_len = sizeof(Loan);
+        decisions[i].error = NULL;
+        long offset = -1;
+        if (decisions[i].status != APPROVED && decisions[i].status != REJECTED)
+            decisions[i].error = "Invalid action. Must be 3 (Approve) or 4 (Reject).\n";
+        else if ((offset = find_loan_offset(fd, decisions[i].loan_id)) == -1)
+            decisions[i].error = "Loan ID not found.\n";
+        if (decisions[i].error == NULL)
+        {
+            targets[valid].offset = offset;
+            targets[valid++].decision = i;
+        }
+    }
+    qsort(targets, valid, sizeof(ReviewTarget), compare_review_targets);
 
-        fcntl(fd, F_SETLKW, &lock);
+    char stripes[LOAN_STRIPES] = {0};
+    int unique = 0;
+    for (int t = 0; t < valid; t++)
+    {
+        if (t > 0 && targets[t].offset == targets[unique - 1].offset)
+        {
+            decisions[targets[t].decision].error = "Error: Loan ID listed more than once.\n";
+            continue;
+        }
+        targets[unique++] = targets[t];
+        stripes[(targets[t].offset / sizeof(Loan)) % LOAN_STRIPES] = 1;
+    }
 
-        lseek(fd, offset, SEEK_SET);
-        read(fd, &loan, sizeof(Loan));
+    // Stripes are locked in ascending order and released before the deposits
+    pthread_once(&loan_stripes_once, init_loan_stripes);
+    for (int s = 0; s < LOAN_STRIPES; s++)
+        if (stripes[s])
+            pthread_mutex_lock(&loan_stripes[s]);
 
-        if (loan.status == PENDING || loan.status == PROCESSING)
+    AccountOp *ops = malloc(sizeof(AccountOp) * (unique + 1));
+    int *op_target = malloc(sizeof(int) * (unique + 1));
+    int op_count = 0;
+    for (int t = 0; t < unique; t++)
+    {
+        LoanDecision *d = &decisions[targets[t].decision];
+        Loan loan;
+        if (loan_read(fd, &loan, targets[t].offset) < 0)
+            d->error = "Loan ID not found.\n";
+        else if (loan.assignedEmployeeID != emp_id)
+            d->error = "Error: This loan is not assigned to you.\n";
+        else if (loan.status != ASSIGNED)
+            d->error = "Error: This loan is not in ASSIGNED status.\n";
+        if (d->error != NULL)
+            continue;
+
+        loan.status = (d->status == APPROVED) ? DISBURSING : REJECTED;
+        if (loan_write(fd, &loan, targets[t].offset) < 0)
+            d->error = "Error: Failed to update loan record.\n";
+        else if (d->status == APPROVED)
         {
-            if (loan.status != PENDING) {
-                write_to_client(sock, "Error: Can only assign PENDING loans.\n");
-            } else {
-                loan.status = ASSIGNED;
-                loan.assignedEmployeeID = emp_id;
-                write_to_client(sock, "Loan assigned successfully.\n");
-            }
+            AccountOp op = {.type = LOAN_DEPOSIT, .account_no = loan.customerUserID,
+                            .amount = loan.amount, .loan_id = loan.loanID};
+            ops[op_count] = op;
+            op_target[op_count++] = t;
+        }
+        track_loan(fd, targets[t].offset);
+    }
 
-            lseek(fd, offset, SEEK_SET);
-            write(fd, &loan, sizeof(Loan));
+    for (int s = LOAN_STRIPES - 1; s >= 0; s--)
+        if (stripes[s])
+            pthread_mutex_unlock(&loan_stripes[s]);
 
-            write_to_client(sock, "Loan status updated successfully.\n");
+    // account_apply_batch returns after the deposits' records are written
+    if (op_count > 0)
+        account_apply_batch(ops, op_count);
+    for (int i = 0; i < op_count; i++)
+    {
+        long offset = targets[op_target[i]].offset;
+        LoanDecision *d = &decisions[targets[op_target[i]].decision];
+        LoanStatus outcome = APPROVED;
+        if (ops[i].result == ACC_NOT_FOUND)
+        {
+            d->error = "Error: Customer account not found; loan left ASSIGNED.\n";
+            outcome = ASSIGNED;
         }
-        else
+        else if (ops[i].result == ACC_INACTIVE)
         {
-            write_to_client(sock, "Error: This loan is not pending or processing.\n");
+            d->error = "Error: Customer account is deactivated; loan left ASSIGNED.\n";
+            outcome = ASSIGNED;
+        }
+        else if (ops[i].result != ACC_OK)
+        {
+            // The deposit may still have reached the log; startup settles it
+            d->error = "Error: Failed to deposit funds; the loan is settled at the next restart.\n";
+            continue;
         }
 
-        lock.l_type = F_UNLCK;
-        fcntl(fd, F_SETLK, &lock);
+        Loan loan;
+        lock_loan(offset);
+        if (loan_read(fd, &loan, offset) == 0 && loan.status == DISBURSING)
+        {
+            loan.status = outcome;
+            if (loan_write(fd, &loan, offset) < 0 && outcome == APPROVED)
+                d->error = "Error: Funds deposited; the loan is marked APPROVED at the next restart.\n";
+            track_loan(fd, offset);
+        }
+        unlock_loan(offset);
     }
-    else
+
+    int applied = 0;
+    for (int i = 0; i < count; i++)
+        if (decisions[i].error == NULL)
+            applied++;
+    free(op_target);
+    free(ops);
+    free(targets);
+    return applied;
+}
+
+// Parses "loanID:action" pairs separated by spaces; returns how many were read
+static int parse_decisions(char *line, LoanDecision *decisions, int max)
+{
+    int count = 0;
+    char *save;
+    for (char *token = strtok_r(line, " \t,", &save); token && count < max; token = strtok_r(NULL, " \t,", &save))
     {
-        write_to_client(sock, "Error: Loan ID not found.\n");
+        int loan_id, action;
+        if (sscanf(token, "%d:%d", &loan_id, &action) != 2)
+            continue;
+        decisions[count].loan_id = loan_id;
+        decisions[count++].status = (LoanStatus)action;
     }
-
-    close(fd);
+    return count;
 }
 
 void employee_process_loan(int sock, User emp_user)
@@ -164,142 +698,100 @@ void employee_process_loan(int sock, User emp_user)
     Loan loan;
 
     // First show all loans assigned to this employee
-    fd = open(LOAN_FILE, O_RDONLY);
-    if (fd < 0) {
-        write_to_client(sock, "Error: Cannot access loan data.\n");
-        return;
-    }
+    fd = data_fd(DATA_LOANS);
 
-    write_to_client(sock, "\n--- Loans Assigned to You ---\n");
-    write_to_client(sock, "ID  | Customer | Amount   | Status\n");
-    write_to_client(sock, "----------------------------------------\n");
+    int count;
+    pthread_mutex_lock(&queue_lock);
+    int *slots = queue_slots(employee_queue(emp_user.userID, 0), EMPLOYEE_LINK, &count);
+    pthread_mutex_unlock(&queue_lock);
 
-    struct flock lock;
-    memset(&lock, 0, sizeof(lock));
-    lock.l_type = F_RDLCK;
-    lock.l_whence = SEEK_SET;
-    lock.l_start = 0;
-    lock.l_len = 0;
-    fcntl(fd, F_SETLKW, &lock);
+    OutBuf out;
+    outbuf_init(&out, sock);
+    outbuf_printf(&out, "\n--- Loans Assigned to You ---\n");
+    outbuf_printf(&out, "ID  | Customer | Amount   | Status\n");
+    outbuf_printf(&out, "----------------------------------------\n");
 
     int found = 0;
-    while (read(fd, &loan, sizeof(Loan)) == sizeof(Loan)) {
-        if (loan.assignedEmployeeID == emp_user.userID && loan.status == ASSIGNED) {
-            sprintf(buffer, "%-3d | %-8d | %-9.2f | ASSIGNED\n",
-                    loan.loanID, loan.customerUserID, loan.amount);
-            write_to_client(sock, buffer);
+    for (int i = 0; i < count; i++) {
+        if (loan_read(fd, &loan, (long)slots[i] * sizeof(Loan)) == 0 &&
+            loan.assignedEmployeeID == emp_user.userID && loan.status == ASSIGNED) {
+            outbuf_printf(&out, "%-3d | %-8d | %-9.2f | ASSIGNED\n",
+                          loan.loanID, loan.customerUserID, loan.amount);
             found = 1;
         }
     }
+    outbuf_flush(&out);
+    free(slots);
 
     if (!found) {
         write_to_client(sock, "No loans are currently assigned to you.\n\n");
-        lock.l_type = F_UNLCK;
-        fcntl(fd, F_SETLK, &lock);
-        close(fd);
         return;
     }
 
-    lock.l_type = F_UNLCK;
-    fcntl(fd, F_SETLK, &lock);
-    close(fd);
-
-    // Process a specific loan
-    write_to_client(sock, "\nEnter Loan ID to process: ");
-    read_from_client(sock, buffer, sizeof(buffer));
-    int loan_id = atoi(buffer);
-
-    write_to_client(sock, "Choose action (3=Approve, 4=Reject): ");
-    read_from_client(sock, buffer, sizeof(buffer));
-    int action = atoi(buffer);
-
-    if (action != 3 && action != 4) {
-        write_to_client(sock, "Invalid action. Must be 3 (Approve) or 4 (Reject).\n");
+    // One loan, or several decisions at once as "loanID:action" pairs
+    write_to_client(sock, "\nEnter loanID:action pairs (e.g. 12:3 15:4), or one Loan ID to process: ");
+    if (read_from_client(sock, buffer, sizeof(buffer)) <= 0)
         return;
-    }
 
-    fd = open(LOAN_FILE, O_RDWR);
-    if (fd < 0) {
-        write_to_client(sock, "Error: Cannot access loan data.\n");
+    if (strchr(buffer, ':') != NULL) {
+        LoanDecision decisions[sizeof(buffer) / 4];
+        int decision_count = parse_decisions(buffer, decisions, sizeof(buffer) / 4);
+        int applied = loan_review_batch(emp_user.userID, decisions, decision_count);
+
+        outbuf_init(&out, sock);
+        for (int i = 0; i < decision_count; i++) {
+            if (decisions[i].error)
+                outbuf_printf(&out, "Loan %d: %s", decisions[i].loan_id, decisions[i].error);
+            else
+                outbuf_printf(&out, "Loan %d: %s\n", decisions[i].loan_id,
+                              decisions[i].status == APPROVED ? "approved and funds deposited" : "rejected");
+        }
+        outbuf_printf(&out, "%d of %d decision(s) applied.\n", applied, decision_count);
+        outbuf_flush(&out);
         return;
     }
 
-    long offset = find_loan_offset(fd, loan_id);
-    if (offset == -1) {
-        write_to_client(sock, "Loan ID not found.\n");
-        close(fd);
+    LoanDecision decision = {.loan_id = atoi(buffer)};
+    write_to_client(sock, "Choose action (3=Approve, 4=Reject): ");
+    if (read_from_client(sock, buffer, sizeof(buffer)) <= 0)
         return;
-    }
+    decision.status = (LoanStatus)atoi(buffer);
 
-    memset(&lock, 0, sizeof(lock));
-    lock.l_type = F_WRLCK;
-    lock.l_start = offset;
-    lock.l_len = sizeof(Loan);
-    fcntl(fd, F_SETLKW, &lock);
+    if (loan_review_batch(emp_user.userID, &decision, 1) == 0)
+        write_to_client(sock, decision.error);
+    else if (decision.status == APPROVED)
+        write_to_client(sock, "Loan approved and funds deposited to account.\n");
+    else
+        write_to_client(sock, "Loan rejected.\n");
+}
 
-    lseek(fd, offset, SEEK_SET);
-    read(fd, &loan, sizeof(Loan));
+// Appends a PENDING loan application; returns its loanID or -1
+int loan_create(int customer_id, float amount)
+{
+    Loan loan;
+    loan.customerUserID = customer_id;
+    loan.amount = amount;
+    loan.status = PENDING;
+    loan.assignedEmployeeID = -1;
 
-    if (loan.assignedEmployeeID != emp_user.userID) {
-        write_to_client(sock, "Error: This loan is not assigned to you.\n");
-    }
-    else if (loan.status != ASSIGNED) {
-        write_to_client(sock, "Error: This loan is not in ASSIGNED status.\n");
-    }
-    else {
-        loan.status = (action == 3) ? APPROVED : REJECTED;
-        lseek(fd, offset, SEEK_SET);
-        write(fd, &loan, sizeof(Loan));
-
-        if (action == 3) { // Approved - process loan deposit
-            int acc_fd = open(ACCOUNT_FILE, O_RDWR);
-            if (acc_fd < 0) {
-                write_to_client(sock, "CRITICAL: Loan approved but failed to open account file!\n");
-            } else {
-                long acc_offset = find_account_offset(acc_fd, loan.customerUserID);
-                if (acc_offset == -1) {
-                    write_to_client(sock, "CRITICAL: Loan approved but customer account not found!\n");
-                } else {
-                    struct flock acc_lock;
-                    memset(&acc_lock, 0, sizeof(acc_lock));
-                    acc_lock.l_type = F_WRLCK;
-                    acc_lock.l_start = acc_offset;
-                    acc_lock.l_len = sizeof(Account);
-                    fcntl(acc_fd, F_SETLKW, &acc_lock);
-
-                    Account acc;
-                    lseek(acc_fd, acc_offset, SEEK_SET);
-                    read(acc_fd, &acc, sizeof(Account));
-
-                    float old_bal = acc.balance;
-                    acc.balance += loan.amount;
-
-                    lseek(acc_fd, acc_offset, SEEK_SET);
-                    write(acc_fd, &acc, sizeof(Account));
-
-                    log_transaction(acc.account_no, LOAN_DEPOSIT, loan.amount, old_bal, acc.balance);
-
-                    acc_lock.l_type = F_UNLCK;
-                    fcntl(acc_fd, F_SETLK, &acc_lock);
-                    write_to_client(sock, "Loan approved and funds deposited to account.\n");
-                }
-                close(acc_fd);
-            }
-        } else {
-            write_to_client(sock, "Loan rejected.\n");
-        }
-    }
+    long offset = data_append_new(DATA_LOANS, &loan, sizeof(Loan), SEQ_LOAN);
+    if (offset == -1)
+        return -1;
 
-    lock.l_type = F_UNLCK;
-    fcntl(fd, F_SETLK, &lock);
-    close(fd);
+    // An assignment may already have reached the record; queue what is there
+    lock_loan(offset);
+    track_loan(data_fd(DATA_LOANS), offset);
+    unlock_loan(offset);
+    auto_assign_loans();
+    return loan.loanID;
 }
 
 void customer_apply_loan(int sock, User user)
 {
     char buffer[1024];
     write_to_client(sock, "Enter loan amount: ");
-    read_from_client(sock, buffer, sizeof(buffer));
+    if (read_from_client(sock, buffer, sizeof(buffer)) <= 0)
+        return;
     float amount = atof(buffer);
 
     if (amount <= 0)
@@ -308,34 +800,13 @@ void customer_apply_loan(int sock, User user)
         return;
     }
 
-    int fd = open(LOAN_FILE, O_RDWR | O_CREAT, 0666);
-    if (fd < 0)
+    int loan_id = loan_create(user.userID, amount);
+    if (loan_id == -1)
     {
-        write_to_client(sock, "Server error: Cannot open loan file.\n");
+        write_to_client(sock, "Server error: Cannot write loan file.\n");
         return;
     }
 
-    struct flock lock;
-    memset(&lock, 0, sizeof(lock));
-    lock.l_type = F_WRLCK;
-    lock.l_start = 0;
-    lock.l_len = 0;
-    fcntl(fd, F_SETLKW, &lock);
-
-    Loan loan;
-    loan.loanID = get_next_loan_id(fd);
-    loan.customerUserID = user.userID;
-    loan.amount = amount;
-    loan.status = PENDING;
-    loan.assignedEmployeeID = -1;
-
-    lseek(fd, 0, SEEK_END);
-    write(fd, &loan, sizeof(Loan));
-
-    lock.l_type = F_UNLCK;
-    fcntl(fd, F_SETLK, &lock);
-    close(fd);
-
-    sprintf(buffer, "Loan application for $%.2f submitted. Loan ID: %d\n", amount, loan.loanID);
+    sprintf(buffer, "Loan application for $%.2f submitted. Loan ID: %d\n", amount, loan_id);
     write_to_client(sock, buffer);
 }
@@ -0,0 +1,153 @@
+#include "../includes/server.h"
+
+// In-process account locks. Account numbers hash onto a fixed table of reader-writer
+// locks, so every thread in the server is isolated without a syscall in the
+// uncontended case. Multi-account operations lock stripes in ascending stripe order.
+//
+// With BANK_FCNTL_LOCKS=1 each holder also takes an fcntl record lock on the
+// account's bytes, for external tools that lock accounts.dat themselves. POSIX
+// record locks belong to the process, so in that mode stripes are always taken
+// exclusively and two threads never share a record lock one of them could drop.
+
+static pthread_rwlock_t *stripes;
+static int stripe_count;
+static int fcntl_mode;
+static int fcntl_fd = -1;
+
+static int stripe_of(int account_no)
+{
+    unsigned int h = (unsigned int)account_no * 0x9E3779B1u;
+    return (h ^ (h >> 16)) % stripe_count;
+}
+
+static void fcntl_record_lock(int account_no, short type)
+{
+    long offset = find_account_offset(fcntl_fd, account_no);
+    if (offset == -1)
+        return;
+
+    struct flock lock;
+    memset(&lock, 0, sizeof(lock));
+    lock.l_type = type;
+    lock.l_whence = SEEK_SET;
+    lock.l_start = offset;
+    lock.l_len = sizeof(Account);
+    while (fcntl(fcntl_fd, type == F_UNLCK ? F_SETLK : F_SETLKW, &lock) == -1 && errno == EINTR)
+        ;
+}
+
+void init_lock_manager(int stripes_wanted, int use_fcntl)
+{
+    stripe_count = stripes_wanted;
+    stripes = malloc(sizeof(pthread_rwlock_t) * stripe_count);
+    for (int i = 0; i < stripe_count; i++)
+        pthread_rwlock_init(&stripes[i], NULL);
+
+    fcntl_mode = use_fcntl;
+    fcntl_fd = data_fd(DATA_ACCOUNTS);
+}
+
+void lock_account(int account_no, int exclusive)
+{
+    pthread_rwlock_t *stripe = &stripes[stripe_of(account_no)];
+    if (exclusive || fcntl_mode)
+        pthread_rwlock_wrlock(stripe);
+    else
+        pthread_rwlock_rdlock(stripe);
+
+    if (fcntl_mode)
+        fcntl_record_lock(account_no, exclusive ? F_WRLCK : F_RDLCK);
+}
+
+void unlock_account(int account_no)
+{
+    if (fcntl_mode)
+        fcntl_record_lock(account_no, F_UNLCK);
+    pthread_rwlock_unlock(&stripes[stripe_of(account_no)]);
+}
+
+static int compare_ints(const void *a, const void *b)
+{
+    int x = *(const int *)a, y = *(const int *)b;
+    return (x > y) - (x < y);
+}
+
+// Exclusive locks on a set of accounts. Stripes are taken once each in ascending
+// order, so concurrent transfers over overlapping accounts cannot deadlock.
+void lock_accounts(const int *account_nos, int count)
+{
+    int local[16];
+    int *order = count <= 16 ? local : malloc(sizeof(int) * count);
+    for (int i = 0; i < count; i++)
+        order[i] = stripe_of(account_nos[i]);
+    qsort(order, count, sizeof(int), compare_ints);
+
+    for (int i = 0; i < count; i++)
+        if (i == 0 || order[i] != order[i - 1])
+            pthread_rwlock_wrlock(&stripes[order[i]]);
+    if (order != local)
+        free(order);
+
+    if (fcntl_mode)
+    {
+        int *sorted = malloc(sizeof(int) * count);
+        memcpy(sorted, account_nos, sizeof(int) * count);
+        qsort(sorted, count, sizeof(int), compare_ints);
+        for (int i = 0; i < count; i++)
+            if (i == 0 || sorted[i] != sorted[i - 1])
+                fcntl_record_lock(sorted[i], F_WRLCK);
+        free(sorted);
+    }
+}
+
+void unlock_accounts(const int *account_nos, int count)
+{
+    if (fcntl_mode)
+        for (int i = 0; i < count; i++)
+            fcntl_record_lock(account_nos[i], F_UNLCK);
+
+    int local[16];
+    int *order = count <= 16 ? local : malloc(sizeof(int) * count);
+    for (int i = 0; i < count; i++)
+        order[i] = stripe_of(account_nos[i]);
+    qsort(order, count, sizeof(int), compare_ints);
+
+    for (int i = count - 1; i >= 0; i--)
+        if (i == 0 || order[i] != order[i - 1])
+            pthread_rwlock_unlock(&stripes[order[i]]);
+    if (order != local)
+        free(order);
+}
+
+// Serializes appends to ACCOUNT_FILE; in fcntl mode also locks the region past EOF
+static pthread_mutex_t account_append_lock = PTHREAD_MUTEX_INITIALIZER;
+
+void lock_account_appends()
+{
+    pthread_mutex_lock(&account_append_lock);
+    if (fcntl_mode)
+    {
+        struct flock lock;
+        memset(&lock, 0, sizeof(lock));
+        lock.l_type = F_WRLCK;
+        lock.l_whence = SEEK_END;
+        lock.l_start = 0;
+        lock.l_len = 0;
+        fcntl(fcntl_fd, F_SETLKW, &lock);
+    }
+}
+
+void unlock_account_appends(long locked_from)
+{
+    if (fcntl_mode)
+    {
+        struct flock lock;
+        memset(&lock, 0, sizeof(lock));
+        lock.l_type = F_UNLCK;
+        lock.l_whence = SEEK_SET;
+        lock.l_start = locked_from;
+        lock.l_len = 0;
+        fcntl(fcntl_fd, F_SETLK, &lock);
+    }
+    pthread_mutex_unlock(&account_append_lock);
+}
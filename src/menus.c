@@ -4,95 +4,71 @@
 int reusable_add_user(int sock, Role adder_role)
 {
     char buffer[1024];
-    int fd = open(USER_FILE, O_RDWR);
-    if (fd < 0)
-    {
-        write_to_client(sock, "Server error: Cannot open user file.\n");
-        return -1;
-    }
-
-    struct flock lock;
-    memset(&lock, 0, sizeof(lock));
-    lock.l_type = F_WRLCK;
-    lock.l_start = 0;
-    lock.l_len = 0;
-    fcntl(fd, F_SETLKW, &lock); // Lock user file
-
-    User user;
-    user.userID = get_next_user_id(fd);
+    char name[50], password[20];
+    Role role;
 
     write_to_client(sock, "Enter name for new user: ");
-    read_from_client(sock, user.name, sizeof(user.name));
+    if (read_from_client(sock, name, sizeof(name)) <= 0)
+        return -1;
 
     write_to_client(sock, "Enter password for new user: ");
-    read_from_client(sock, user.password, sizeof(user.password));
+    if (read_from_client(sock, password, sizeof(password)) <= 0)
+        return -1;
 
     if (adder_role == ADMIN)
     {
         write_to_client(sock, "Enter role (1=Cust, 3=Emp, 4=Mgr): ");
-        read_from_client(sock, buffer, sizeof(buffer));
-        user.role = (Role)atoi(buffer);
+        if (read_from_client(sock, buffer, sizeof(buffer)) <= 0)
+            return -1;
+        role = (Role)atoi(buffer);
     }
     else
     { // Employee adding a customer
-        user.role = CUSTOMER;
+        role = CUSTOMER;
     }
-    user.is_active = 1; // Active by default
 
-    lseek(fd, 0, SEEK_END);
-    write(fd, &user, sizeof(User));
+    int user_id = user_create(name, password, role);
+    if (user_id == -1)
+    {
+        write_to_client(sock, "Server error: Cannot write user file.\n");
+        return -1;
+    }
 
-    sprintf(buffer, "User %d (%s) added successfully!\n", user.userID, user.name);
+    sprintf(buffer, "User %d (%s) added successfully!\n", user_id, name);
     write_to_client(sock, buffer);
-
-    lock.l_type = F_UNLCK;
-    fcntl(fd, F_SETLK, &lock);
-    close(fd);
-    return user.userID;
+    return user_id;
 }
 
 void reusable_add_bank_account(int sock, int new_account_no)
 {
     char buffer[1024];
-    int fd = open(ACCOUNT_FILE, O_RDWR | O_CREAT, 0666);
-    if (fd < 0)
+    Account existing;
+    int result = account_get(new_account_no, &existing);
+    if (result == ACC_OK)
     {
-        write_to_client(sock, "Server error: Cannot open account file.\n");
+        write_to_client(sock, "Error: Bank account for this user already exists.\n");
         return;
     }
 
-    struct flock lock;
-    memset(&lock, 0, sizeof(lock));
-    lock.l_type = F_WRLCK;
-    lock.l_start = 0;
-    lock.l_len = 0;
-    fcntl(fd, F_SETLKW, &lock); // Lock account file
+    write_to_client(sock, "Enter initial balance for new account: ");
+    if (read_from_client(sock, buffer, sizeof(buffer)) <= 0)
+        return;
+    float balance = atof(buffer);
 
-    if (find_account_offset(fd, new_account_no) != -1)
+    result = account_create(new_account_no, balance);
+    if (result == ACC_EXISTS)
     {
         write_to_client(sock, "Error: Bank account for this user already exists.\n");
     }
+    else if (result != ACC_OK)
+    {
+        write_to_client(sock, "Server error: Cannot open account file.\n");
+    }
     else
     {
-        Account acc;
-        acc.account_no = new_account_no; // Link to UserID
-
-        write_to_client(sock, "Enter initial balance for new account: ");
-        read_from_client(sock, buffer, sizeof(buffer));
-        acc.balance = atof(buffer);
-
-        acc.is_active = 1; // Active by default
-
-        lseek(fd, 0, SEEK_END);
-        write(fd, &acc, sizeof(Account));
-
-        sprintf(buffer, "Bank account %d created successfully!\n", acc.account_no);
+        sprintf(buffer, "Bank account %d created successfully!\n", new_account_no);
         write_to_client(sock, buffer);
     }
-
-    lock.l_type = F_UNLCK;
-    fcntl(fd, F_SETLK, &lock);
-    close(fd);
 }
 
 void reusable_modify_user(int sock, Role modifier_role, int target_userID)
@@ -103,19 +79,15 @@ void reusable_modify_user(int sock, Role modifier_role, int target_userID)
     if (target_userID == -1)
     { // Admin / Employee modifying Customer
         write_to_client(sock, "Enter UserID to modify: ");
-        read_from_client(sock, buffer, sizeof(buffer));
+        if (read_from_client(sock, buffer, sizeof(buffer)) <= 0)
+            return;
         user_to_modify = atoi(buffer);
     }
     else
     { // User modifying their own password
         user_to_modify = target_userID;
     }
-    int fd = open(USER_FILE, O_RDWR);
-    if (fd < 0)
-    {
-        write_to_client(sock, "Server error: Cannot open user file.\n");
-        return;
-    }
+    int fd = data_fd(DATA_USERS);
     long offset = find_user_offset(fd, user_to_modify);
     if (offset == -1)
     {
@@ -131,8 +103,7 @@ void reusable_modify_user(int sock, Role modifier_role, int target_userID)
         fcntl(fd, F_SETLKW, &lock);
 
         User user;
-        lseek(fd, offset, SEEK_SET);
-        read(fd, &user, sizeof(User));
+        pread(fd, &user, sizeof(User), offset);
 
         if (modifier_role == EMPLOYEE && user.role != CUSTOMER)
         {
@@ -140,41 +111,39 @@ void reusable_modify_user(int sock, Role modifier_role, int target_userID)
         }
         else
         {
+            // A disconnect leaves the user unchanged
             write_to_client(sock, "Enter new password (leave blank to keep): ");
-            read_from_client(sock, buffer, sizeof(buffer));
-            if (strlen(buffer) > 0)
+            int connected = read_from_client(sock, buffer, sizeof(buffer)) > 0;
+            if (connected && strlen(buffer) > 0)
                 strcpy(user.password, buffer);
 
-            if (target_userID == -1)
+            if (connected && target_userID == -1)
             { // Only admin/emp can change name
                 write_to_client(sock, "Enter new name (leave blank to keep): ");
-                read_from_client(sock, buffer, sizeof(buffer));
-                if (strlen(buffer) > 0)
+                connected = read_from_client(sock, buffer, sizeof(buffer)) > 0;
+                if (connected && strlen(buffer) > 0)
                     strcpy(user.name, buffer);
             }
-            lseek(fd, offset, SEEK_SET);
-            write(fd, &user, sizeof(User));
-            write_to_client(sock, "User updated.\n");
+            if (connected)
+            {
+                pwrite(fd, &user, sizeof(User), offset);
+                write_to_client(sock, "User updated.\n");
+            }
         }
         lock.l_type = F_UNLCK;
         fcntl(fd, F_SETLK, &lock);
     }
-    close(fd);
 }
 
 void reusable_activate_deactivate_user(int sock, int choice)
 {
     char buffer[1024];
     write_to_client(sock, "Enter UserID to modify: ");
-    read_from_client(sock, buffer, sizeof(buffer));
+    if (read_from_client(sock, buffer, sizeof(buffer)) <= 0)
+        return;
     int user_id = atoi(buffer);
 
-    int fd = open(USER_FILE, O_RDWR);
-    if (fd < 0)
-    {
-        write_to_client(sock, "Server error.\n");
-        return;
-    }
+    int fd = data_fd(DATA_USERS);
 
     long offset = find_user_offset(fd, user_id);
     if (offset == -1)
@@ -191,59 +160,67 @@ void reusable_activate_deactivate_user(int sock, int choice)
         fcntl(fd, F_SETLKW, &lock);
 
         User user;
-        lseek(fd, offset, SEEK_SET);
-        read(fd, &user, sizeof(User));
+        pread(fd, &user, sizeof(User), offset);
         user.is_active = (choice == 2) ? 0 : 1;
-        lseek(fd, offset, SEEK_SET);
-        write(fd, &user, sizeof(User));
+        pwrite(fd, &user, sizeof(User), offset);
 
         lock.l_type = F_UNLCK;
         fcntl(fd, F_SETLK, &lock);
+        if (user.role == EMPLOYEE)
+            loan_roster_update(user.userID, user.is_active);
         write_to_client(sock, (choice == 2) ? "User login deactivated.\n" : "User login activated.\n");
     }
-    close(fd);
 }
 
 void reusable_activate_deactivate_account(int sock, int choice)
 {
     char buffer[1024];
     write_to_client(sock, "Enter Customer Account Number to modify: ");
-    read_from_client(sock, buffer, sizeof(buffer));
+    if (read_from_client(sock, buffer, sizeof(buffer)) <= 0)
+        return;
     int acc_no = atoi(buffer);
 
-    int fd = open(ACCOUNT_FILE, O_RDWR);
-    if (fd < 0)
-    {
+    int result = account_set_active(acc_no, (choice == 2) ? 0 : 1);
+    if (result == ACC_NOT_FOUND)
+        write_to_client(sock, "Bank account not found.\n");
+    else if (result != ACC_OK)
         write_to_client(sock, "Server error.\n");
-        return;
-    }
+    else
+        write_to_client(sock, (choice == 2) ? "Bank account deactivated.\n" : "Bank account activated.\n");
+}
 
-    long offset = find_account_offset(fd, acc_no);
-    if (offset == -1)
+void view_server_status(int sock)
+{
+    char buffer[1024];
+    if (server_config.io_model == IO_EPOLL)
     {
-        write_to_client(sock, "Bank account not found.\n");
+        ReactorStats stats;
+        reactor_stats(&stats);
+        sprintf(buffer, "\n--- Server Status ---\n"
+                        "Epoll reactors: %d\n"
+                        "Active sessions: %ld\n"
+                        "Sessions served: %ld\n"
+                        "Logged-in users: %d / %d\n",
+                stats.reactors, stats.active_sessions, stats.total_sessions,
+                active_login_count(), login_capacity());
+        write_to_client(sock, buffer);
+        return;
     }
-    else
-    {
-        struct flock lock;
-        memset(&lock, 0, sizeof(lock));
-        lock.l_type = F_WRLCK;
-        lock.l_start = offset;
-        lock.l_len = sizeof(Account);
-        fcntl(fd, F_SETLKW, &lock);
-
-        Account acc;
-        lseek(fd, offset, SEEK_SET);
-        read(fd, &acc, sizeof(Account));
-        acc.is_active = (choice == 2) ? 0 : 1;
-        lseek(fd, offset, SEEK_SET);
-        write(fd, &acc, sizeof(Account));
 
-        lock.l_type = F_UNLCK;
-        fcntl(fd, F_SETLK, &lock);
-        write_to_client(sock, (choice == 2) ? "Bank account deactivated.\n" : "Bank account activated.\n");
-    }
-    close(fd);
+    PoolStats stats;
+    thread_pool_stats(&stats);
+    sprintf(buffer, "\n--- Server Status ---\n"
+                    "Workers busy: %d / %d\n"
+                    "Queue depth: %d / %d (peak %d, full %ld times)\n"
+                    "Sessions served: %ld\n"
+                    "Worker utilization: %.1f%%\n"
+                    "Logged-in users: %d / %d\n",
+            stats.busy_workers, stats.workers,
+            stats.queue_depth, stats.queue_capacity, stats.peak_queue_depth, stats.full_waits,
+            stats.served,
+            stats.utilization * 100,
+            active_login_count(), login_capacity());
+    write_to_client(sock, buffer);
 }
 
 // Menus
@@ -252,13 +229,13 @@ void admin_menu(int sock, User admin_user)
     char buffer[1024];
     while (1)
     {
-        write_to_client(sock, "\n--- Admin Menu ---\n1. Add User\n2. Deactivate User\n3. Activate User\n4. Modify User\n5. Search User\n6. Add Bank Account for Customer\n7. View Feedbacks\n8. Exit\nChoice: ");
+        write_to_client(sock, "\n--- Admin Menu ---\n1. Add User\n2. Deactivate User\n3. Activate User\n4. Modify User\n5. Search User\n6. Add Bank Account for Customer\n7. View Feedbacks\n8. Server Status\n9. Batch Commands\n10. Exit\nChoice: ");
         int choice;
         if (read_from_client(sock, buffer, sizeof(buffer)) <= 0)
-            choice = 8; // Force exit on disconnect
+            choice = 10; // Force exit on disconnect
         else
             choice = atoi(buffer);
-        if (choice == 8)
+        if (choice == 10)
             break;
 
         if (choice == 1)
@@ -269,26 +246,15 @@ void admin_menu(int sock, User admin_user)
                 continue;
             }
 
-            int fd = open(USER_FILE, O_RDONLY);
-            if (fd < 0)
-            {
-                write_to_client(sock, "Server error: Cannot verify new user role.\n");
-                continue;
-            }
-
+            int fd = data_fd(DATA_USERS);
             long offset = find_user_offset(fd, new_user_id);
-            if (offset == -1)
+            User new_user;
+            if (offset == -1 || pread(fd, &new_user, sizeof(User), offset) != sizeof(User))
             {
                 write_to_client(sock, "Server error: Cannot find new user.\n");
-                close(fd);
                 continue;
             }
 
-            User new_user;
-            lseek(fd, offset, SEEK_SET);
-            read(fd, &new_user, sizeof(User));
-            close(fd);
-
             if (new_user.role == CUSTOMER)
             {
                 write_to_client(sock, "New user is a Customer. Proceeding to create bank account...\n");
@@ -310,16 +276,11 @@ void admin_menu(int sock, User admin_user)
         else if (choice == 5)
         {
             write_to_client(sock, "Enter UserID to search: ");
-            read_from_client(sock, buffer, sizeof(buffer));
+            if (read_from_client(sock, buffer, sizeof(buffer)) <= 0)
+                break;
             int user_id = atoi(buffer);
 
-            int fd = open(USER_FILE, O_RDONLY);
-            if (fd < 0)
-            {
-                write_to_client(sock, "Server error: Cannot open user file.\n");
-                continue;
-            }
-
+            int fd = data_fd(DATA_USERS);
             long offset = find_user_offset(fd, user_id);
             if (offset == -1)
             {
@@ -328,18 +289,17 @@ void admin_menu(int sock, User admin_user)
             else
             {
                 User user;
-                lseek(fd, offset, SEEK_SET);
-                read(fd, &user, sizeof(User));
+                pread(fd, &user, sizeof(User), offset);
                 sprintf(buffer, "UserID: %d\nName: %s\nRole: %d\nActive: %d\n\n",
                         user.userID, user.name, user.role, user.is_active);
                 write_to_client(sock, buffer);
             }
-            close(fd);
         }
         else if (choice == 6)
         {
             write_to_client(sock, "Enter Customer UserID to create account for: ");
-            read_from_client(sock, buffer, sizeof(buffer));
+            if (read_from_client(sock, buffer, sizeof(buffer)) <= 0)
+                break;
             int user_id = atoi(buffer);
             reusable_add_bank_account(sock, user_id);
         }
@@ -347,6 +307,14 @@ void admin_menu(int sock, User admin_user)
         {
             view_feedbacks(sock);
         }
+        else if (choice == 8)
+        {
+            view_server_status(sock);
+        }
+        else if (choice == 9)
+        {
+            batch_session(sock);
+        }
         else
         {
             write_to_client(sock, "Invalid choice.\n");
@@ -359,13 +327,13 @@ void manager_menu(int sock, User mgr_user)
     char buffer[1024];
     while (1)
     {
-        write_to_client(sock, "\n--- Manager Menu ---\n1. Activate Customer Account\n2. Deactivate Customer Account\n3. View Pending Loans\n4. Assign (Approve/Reject) Loan\n5. View Feedbacks\n6. Exit\nChoice: ");
+        write_to_client(sock, "\n--- Manager Menu ---\n1. Activate Customer Account\n2. Deactivate Customer Account\n3. View Pending Loans\n4. Assign (Approve/Reject) Loan\n5. View Feedbacks\n6. Transactions by Date\n7. Exit\nChoice: ");
         int choice;
         if (read_from_client(sock, buffer, sizeof(buffer)) <= 0)
-            choice = 6; // Force exit on disconnect
+            choice = 7; // Force exit on disconnect
         else
             choice = atoi(buffer);
-        if (choice == 6)
+        if (choice == 7)
             break;
 
         if (choice == 1)
@@ -388,6 +356,10 @@ void manager_menu(int sock, User mgr_user)
         {
             view_feedbacks(sock);
         }
+        else if (choice == 6)
+        {
+            browse_transactions_by_date(sock);
+        }
         else
         {
             write_to_client(sock, "Invalid choice.\n");
@@ -433,9 +405,10 @@ void employee_menu(int sock, User emp_user)
         else if (choice == 5)
         {
             write_to_client(sock, "Enter Customer Account Number: ");
-            read_from_client(sock, buffer, sizeof(buffer));
+            if (read_from_client(sock, buffer, sizeof(buffer)) <= 0)
+                break;
             int acc_no = atoi(buffer);
-            view_transactions(sock, acc_no);
+            browse_transactions(sock, acc_no);
         }
         else if (choice == 6)
         {
@@ -454,17 +427,7 @@ void customer_menu(int sock, User user, Account account)
     int choice;
     while (1)
     {
-        int fd_acc_check = open(ACCOUNT_FILE, O_RDONLY);
-        if (fd_acc_check > 0)
-        {
-            long acc_off = find_account_offset(fd_acc_check, account.account_no);
-            if (acc_off != -1)
-            {
-                lseek(fd_acc_check, acc_off, SEEK_SET);
-                read(fd_acc_check, &account, sizeof(Account));
-            }
-            close(fd_acc_check);
-        }
+        account_get(account.account_no, &account);
 
         sprintf(buffer, "\n--- Customer Menu (User: %s, Account: %d) ---\n"
                         "1. Deposit\n"
@@ -483,7 +446,7 @@ void customer_menu(int sock, User user, Account account)
 
         if (read_from_client(sock, buffer, sizeof(buffer)) <= 0)
         {
-            choice = 9;
+            break; // Force exit on disconnect
         }
         else
         {
@@ -497,92 +460,66 @@ void customer_menu(int sock, User user, Account account)
                 continue;
             }
 
-            if (choice == 1 || choice == 2 || choice == 3 || choice == 5)
+            if (choice == 1 || choice == 2)
             {
-                int fd = open(ACCOUNT_FILE, O_RDWR);
-                if (fd < 0)
+                write_to_client(sock, choice == 1 ? "Enter amount to deposit: " : "Enter amount to withdraw: ");
+                if (read_from_client(sock, buffer, sizeof(buffer)) <= 0)
+                    break;
+                float amt = atof(buffer);
+
+                int result = (choice == 1) ? account_deposit(account.account_no, amt, DEPOSIT, NULL)
+                                           : account_withdraw(account.account_no, amt, NULL);
+                if (result == ACC_INVALID)
                 {
-                    write_to_client(sock, "Error accessing account data.\n");
-                    continue;
+                    write_to_client(sock, "Invalid amount.\n");
                 }
-
-                long offset = find_account_offset(fd, account.account_no);
-                if (offset == -1)
+                else if (result == ACC_INSUFFICIENT)
+                {
+                    write_to_client(sock, "Insufficient balance.\n");
+                }
+                else if (result == ACC_INACTIVE)
+                {
+                    write_to_client(sock, "Your bank account is deactivated. Please contact a manager.\n");
+                }
+                else if (result == ACC_NOT_FOUND)
                 {
                     write_to_client(sock, "CRITICAL ERROR: Account not found.\n");
-                    close(fd);
                     break;
                 }
-
-                struct flock lock;
-                memset(&lock, 0, sizeof(lock));
-                lock.l_type = (choice == 1 || choice == 2) ? F_WRLCK : F_RDLCK;
-                lock.l_whence = SEEK_SET;
-                lock.l_start = offset;
-                lock.l_len = sizeof(Account);
-                fcntl(fd, F_SETLKW, &lock);
-
-                lseek(fd, offset, SEEK_SET);
-                read(fd, &account, sizeof(Account));
-
-                if (choice == 1)
+                else if (result != ACC_OK)
                 {
-                    write_to_client(sock, "Enter amount to deposit: ");
-                    read_from_client(sock, buffer, sizeof(buffer));
-                    float amt = atof(buffer);
-                    if (amt <= 0)
-                    {
-                        write_to_client(sock, "Invalid amount.\n");
-                    }
-                    else
-                    {
-                        float old_bal = account.balance;
-                        account.balance += amt;
-                        lseek(fd, offset, SEEK_SET);
-                        write(fd, &account, sizeof(Account));
-                        log_transaction(account.account_no, DEPOSIT, amt, old_bal, account.balance);
-                        write_to_client(sock, "Deposit successful.\n");
-                    }
+                    write_to_client(sock, "Error accessing account data.\n");
+                }
+                else
+                {
+                    write_to_client(sock, choice == 1 ? "Deposit successful.\n" : "Withdrawal successful.\n");
+                }
+            }
+            else if (choice == 3 || choice == 5)
+            {
+                int result = account_get(account.account_no, &account);
+                if (result == ACC_NOT_FOUND)
+                {
+                    write_to_client(sock, "CRITICAL ERROR: Account not found.\n");
+                    break;
                 }
-                else if (choice == 2)
+                else if (result != ACC_OK)
                 {
-                    write_to_client(sock, "Enter amount to withdraw: ");
-                    read_from_client(sock, buffer, sizeof(buffer));
-                    float amt = atof(buffer);
-                    if (amt <= 0)
-                    {
-                        write_to_client(sock, "Invalid amount.\n");
-                    }
-                    else if (account.balance >= amt)
-                    {
-                        float old_bal = account.balance;
-                        account.balance -= amt;
-                        lseek(fd, offset, SEEK_SET);
-                        write(fd, &account, sizeof(Account));
-                        log_transaction(account.account_no, WITHDRAWAL, amt, old_bal, account.balance);
-                        write_to_client(sock, "Withdrawal successful.\n");
-                    }
-                    else
-                    {
-                        write_to_client(sock, "Insufficient balance.\n");
-                    }
+                    write_to_client(sock, "Error accessing account data.\n");
                 }
                 else if (choice == 3)
                 {
                     sprintf(buffer, "Your current balance: %.2f\n", account.balance);
                     write_to_client(sock, buffer);
                 }
-                else if (choice == 5)
+                else
                 {
-                    sprintf(buffer, "Account No: %d\nBalance: %.2f\nJoint: %s\nActive: %s\n",
+                    sprintf(buffer, "Account No: %d\nBalance: %.2f\nActive: %s\n",
                             account.account_no,
                             account.balance,
                             account.is_active ? "Yes" : "No");
                     write_to_client(sock, buffer);
                 }
-                lock.l_type = F_UNLCK;
-                fcntl(fd, F_SETLK, &lock);
-                close(fd);
             }
             else if (choice == 4)
             {
@@ -594,12 +531,13 @@ void customer_menu(int sock, User user, Account account)
             }
             else if (choice == 7)
             {
-                view_transactions(sock, account.account_no);
+                browse_transactions(sock, account.account_no);
             }
             else if (choice == 8)
             {
                 write_to_client(sock, "Enter feedback message (single line): ");
-                read_from_client(sock, buffer, sizeof(buffer));
+                if (read_from_client(sock, buffer, sizeof(buffer)) <= 0)
+                    break;
                 give_feedback(account.account_no, buffer);
                 write_to_client(sock, "Thank you for your feedback.\n");
             }
@@ -607,7 +545,8 @@ void customer_menu(int sock, User user, Account account)
             {
                 // Transfer funds
                 write_to_client(sock, "Enter destination account number: ");
-                read_from_client(sock, buffer, sizeof(buffer));
+                if (read_from_client(sock, buffer, sizeof(buffer)) <= 0)
+                    break;
                 int to_account = atoi(buffer);
 
                 if (to_account == account.account_no)
@@ -617,7 +556,8 @@ void customer_menu(int sock, User user, Account account)
                 else
                 {
                     write_to_client(sock, "Enter amount to transfer: ");
-                    read_from_client(sock, buffer, sizeof(buffer));
+                    if (read_from_client(sock, buffer, sizeof(buffer)) <= 0)
+                        break;
                     float amount = atof(buffer);
 
                     transfer_funds(sock, account.account_no, to_account, amount);
@@ -0,0 +1,208 @@
+#include "../includes/server.h"
+#include <stdint.h>
+
+// Framed binary protocol for automated clients. A connection switches to it when
+// its first byte is FRAME_MAGIC instead of a text reply to the UserID prompt (the
+// client skips the greeting by discarding bytes up to the first FRAME_MAGIC).
+//
+// Every frame is a 12-byte header in network byte order followed by the payload:
+//   u8 magic | u8 opcode | i16 status | u32 request_id | u32 payload length
+// Requests are answered in order with the same opcode and request_id. Clients may
+// send many requests without waiting; replies are buffered and written together
+// once no further complete request header is waiting in the input buffer.
+//
+// Amounts and balances are signed 64-bit cents. Payloads:
+//   FRAME_LOGIN    u32 userID, password bytes -> empty
+//   FRAME_BALANCE  empty                      -> i64 balance
+//   FRAME_DEPOSIT  i64 amount                 -> i64 new balance
+//   FRAME_WITHDRAW i64 amount                 -> i64 new balance
+//   FRAME_TRANSFER u32 to_account, i64 amount -> empty
+//   FRAME_LOGOUT   empty                      -> empty, then the server closes
+
+#define FRAME_OUT_SIZE 8192
+
+typedef struct
+{
+    int sock;
+    int logged_in;
+    User user;
+    char out[FRAME_OUT_SIZE];
+    int out_len;
+} FrameSession;
+
+static uint32_t get_u32(const unsigned char *p)
+{
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+static int64_t get_i64(const unsigned char *p)
+{
+    return (int64_t)(((uint64_t)get_u32(p) << 32) | get_u32(p + 4));
+}
+
+static void put_u32(unsigned char *p, uint32_t v)
+{
+    p[0] = v >> 24;
+    p[1] = v >> 16;
+    p[2] = v >> 8;
+    p[3] = v;
+}
+
+static void put_i64(unsigned char *p, int64_t v)
+{
+    put_u32(p, (uint64_t)v >> 32);
+    put_u32(p + 4, (uint32_t)v);
+}
+
+static int64_t to_cents(float amount)
+{
+    return (int64_t)(amount * 100.0 + (amount < 0 ? -0.5 : 0.5));
+}
+
+static void flush_replies(FrameSession *session)
+{
+    if (session->out_len > 0)
+        write_client_bytes(session->sock, session->out, session->out_len);
+    session->out_len = 0;
+}
+
+static void reply(FrameSession *session, int opcode, uint32_t request_id, int status,
+                  const unsigned char *payload, uint32_t length)
+{
+    if (session->out_len + FRAME_HEADER_SIZE + (int)length > FRAME_OUT_SIZE)
+        flush_replies(session);
+
+    unsigned char *p = (unsigned char *)session->out + session->out_len;
+    p[0] = FRAME_MAGIC;
+    p[1] = opcode;
+    p[2] = (uint16_t)status >> 8;
+    p[3] = (uint16_t)status;
+    put_u32(p + 4, request_id);
+    put_u32(p + 8, length);
+    if (length > 0)
+        memcpy(p + FRAME_HEADER_SIZE, payload, length);
+    session->out_len += FRAME_HEADER_SIZE + length;
+}
+
+static int frame_login(FrameSession *session, const unsigned char *payload, uint32_t length)
+{
+    if (session->logged_in || length < 4 || length - 4 >= sizeof(session->user.password))
+        return FRAME_BAD_REQUEST;
+
+    char pass[sizeof(session->user.password)] = {0};
+    memcpy(pass, payload + 4, length - 4);
+
+    int user_fd = data_fd(DATA_USERS);
+    long user_offset = find_user_offset(user_fd, (int)get_u32(payload));
+    User user;
+    if (user_offset == -1 || pread(user_fd, &user, sizeof(User), user_offset) != sizeof(User) ||
+        strcmp(user.password, pass) != 0 || !user.is_active || user.role != CUSTOMER)
+        return FRAME_LOGIN_FAILED;
+
+    if (claim_login(user.userID) != LOGIN_OK)
+        return FRAME_LOGIN_BUSY;
+
+    session->user = user;
+    session->logged_in = 1;
+    return FRAME_OK;
+}
+
+// Runs one request and queues its reply; returns 0 to keep the connection open
+static int handle_frame(FrameSession *session, int opcode, uint32_t request_id,
+                        const unsigned char *payload, uint32_t length)
+{
+    unsigned char out[8];
+    Account account;
+    float balance;
+    int status;
+
+    if (opcode == FRAME_LOGIN)
+    {
+        reply(session, opcode, request_id, frame_login(session, payload, length), NULL, 0);
+        return 0;
+    }
+    if (opcode == FRAME_LOGOUT)
+    {
+        reply(session, opcode, request_id, FRAME_OK, NULL, 0);
+        return -1;
+    }
+    if (!session->logged_in)
+    {
+        reply(session, opcode, request_id, FRAME_NOT_LOGGED_IN, NULL, 0);
+        return 0;
+    }
+
+    int account_no = session->user.userID;
+    switch (opcode)
+    {
+    case FRAME_BALANCE:
+        status = account_get(account_no, &account);
+        if (status == ACC_OK)
+        {
+            put_i64(out, to_cents(account.balance));
+            reply(session, opcode, request_id, status, out, 8);
+            return 0;
+        }
+        break;
+    case FRAME_DEPOSIT:
+    case FRAME_WITHDRAW:
+        if (length != 8)
+        {
+            status = FRAME_BAD_REQUEST;
+            break;
+        }
+        status = account_get(account_no, &account);
+        if (status == ACC_OK && !account.is_active)
+            status = ACC_INACTIVE;
+        if (status == ACC_OK)
+        {
+            float amount = get_i64(payload) / 100.0f;
+            status = (opcode == FRAME_DEPOSIT) ? account_deposit(account_no, amount, DEPOSIT, &balance)
+                                               : account_withdraw(account_no, amount, &balance);
+        }
+        if (status == ACC_OK)
+        {
+            put_i64(out, to_cents(balance));
+            reply(session, opcode, request_id, status, out, 8);
+            return 0;
+        }
+        break;
+    case FRAME_TRANSFER:
+        status = (length == 12) ? account_transfer(account_no, (int)get_u32(payload), get_i64(payload + 4) / 100.0f)
+                                : FRAME_BAD_REQUEST;
+        break;
+    default:
+        status = FRAME_BAD_REQUEST;
+    }
+    reply(session, opcode, request_id, status, NULL, 0);
+    return 0;
+}
+
+void frame_session(int sock)
+{
+    FrameSession *session = calloc(1, sizeof(FrameSession));
+    session->sock = sock;
+
+    unsigned char header[FRAME_HEADER_SIZE];
+    unsigned char payload[FRAME_MAX_PAYLOAD];
+    while (1)
+    {
+        // Only block for input once every reply so far has been sent
+        if (client_buffered(sock) < FRAME_HEADER_SIZE)
+            flush_replies(session);
+        if (read_client_bytes(sock, header, FRAME_HEADER_SIZE) <= 0 || header[0] != FRAME_MAGIC)
+            break;
+
+        uint32_t request_id = get_u32(header + 4);
+        uint32_t length = get_u32(header + 8);
+        if (length > FRAME_MAX_PAYLOAD || (length > 0 && read_client_bytes(sock, payload, length) <= 0))
+            break;
+        if (handle_frame(session, header[1], request_id, payload, length) != 0)
+            break;
+    }
+    flush_replies(session);
+
+    if (session->logged_in)
+        release_login(session->user.userID);
+    free(session);
+}
@@ -0,0 +1,182 @@
+#include "../includes/server.h"
+#include <stdint.h>
+#include <sys/epoll.h>
+#include <sys/mman.h>
+#include <ucontext.h>
+
+// Event-driven session engine: a few reactor threads each own an epoll set and run
+// every session on it as a coroutine. The menu code stays sequential; whenever a
+// socket would block, read_from_client/write_to_client park the coroutine until
+// epoll reports the socket ready again.
+
+#define REACTOR_MAX_EVENTS 256
+
+struct Session
+{
+    int sock;
+    int started;
+    int finished;
+    ucontext_t context;
+    void *stack;
+    size_t stack_size;
+    Reactor *reactor;
+};
+
+struct Reactor
+{
+    int epoll_fd;
+    pthread_t thread;
+    ucontext_t context; // where parked or finished sessions return to
+    long active_sessions;
+    long total_sessions;
+};
+
+static Reactor *reactors;
+static int reactor_count;
+static int next_reactor;
+static size_t page_size;
+
+static __thread Session *current_session;
+
+// Stacks are reserved lazily, with a guard page below to trap overflow
+static void *alloc_stack(size_t size)
+{
+    void *stack = mmap(NULL, size + page_size, PROT_READ | PROT_WRITE,
+                       MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | MAP_STACK, -1, 0);
+    if (stack == MAP_FAILED)
+        return NULL;
+    mprotect(stack, page_size, PROT_NONE);
+    return (char *)stack + page_size;
+}
+
+static void free_stack(void *stack, size_t size)
+{
+    munmap((char *)stack - page_size, size + page_size);
+}
+
+static void session_entry(void)
+{
+    Session *session = current_session;
+    handle_client(session->sock);
+    session->finished = 1;
+    // returning resumes the reactor through uc_link
+}
+
+static void resume_session(Reactor *reactor, Session *session)
+{
+    current_session = session;
+    if (!session->started)
+    {
+        session->started = 1;
+        getcontext(&session->context);
+        session->context.uc_stack.ss_sp = session->stack;
+        session->context.uc_stack.ss_size = session->stack_size;
+        session->context.uc_link = &reactor->context;
+        makecontext(&session->context, session_entry, 0);
+    }
+    swapcontext(&reactor->context, &session->context);
+    current_session = NULL;
+
+    if (session->finished)
+    {
+        free_stack(session->stack, session->stack_size);
+        free(session);
+        __atomic_sub_fetch(&reactor->active_sessions, 1, __ATOMIC_RELAXED);
+    }
+}
+
+static void *reactor_main(void *arg)
+{
+    Reactor *reactor = arg;
+    struct epoll_event events[REACTOR_MAX_EVENTS];
+
+    while (1)
+    {
+        int ready = epoll_wait(reactor->epoll_fd, events, REACTOR_MAX_EVENTS, -1);
+        if (ready < 0)
+        {
+            if (errno != EINTR)
+                perror("epoll_wait");
+            continue;
+        }
+        for (int i = 0; i < ready; i++)
+            resume_session(reactor, events[i].data.ptr);
+    }
+    return NULL;
+}
+
+void reactor_start(int count)
+{
+    page_size = sysconf(_SC_PAGESIZE);
+    reactors = calloc(count, sizeof(Reactor));
+    for (int i = 0; i < count; i++)
+    {
+        reactors[i].epoll_fd = epoll_create1(0);
+        if (reactors[i].epoll_fd < 0 || pthread_create(&reactors[i].thread, NULL, reactor_main, &reactors[i]) != 0)
+        {
+            perror("Failed to start reactor");
+            exit(EXIT_FAILURE);
+        }
+        reactor_count++;
+    }
+}
+
+// Called from the accept loop; the first writable event starts the session
+void reactor_add(int sock)
+{
+    Session *session = calloc(1, sizeof(Session));
+    session->sock = sock;
+    session->stack_size = (size_t)server_config.session_stack_kb * 1024;
+    session->stack = alloc_stack(session->stack_size);
+    if (session->stack == NULL)
+    {
+        perror("Failed to allocate session stack");
+        free(session);
+        close(sock);
+        return;
+    }
+
+    fcntl(sock, F_SETFL, fcntl(sock, F_GETFL) | O_NONBLOCK);
+
+    Reactor *reactor = &reactors[next_reactor];
+    next_reactor = (next_reactor + 1) % reactor_count;
+    session->reactor = reactor;
+    __atomic_add_fetch(&reactor->active_sessions, 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&reactor->total_sessions, 1, __ATOMIC_RELAXED);
+
+    struct epoll_event event = {.events = EPOLLOUT | EPOLLONESHOT, .data.ptr = session};
+    if (epoll_ctl(reactor->epoll_fd, EPOLL_CTL_ADD, sock, &event) < 0)
+    {
+        perror("epoll_ctl");
+        __atomic_sub_fetch(&reactor->active_sessions, 1, __ATOMIC_RELAXED);
+        free_stack(session->stack, session->stack_size);
+        free(session);
+        close(sock);
+    }
+}
+
+// Parks the calling session until sock is ready for events. Returns -1 when the
+// caller is not running inside a reactor session and should block instead.
+int session_wait(int sock, int events)
+{
+    Session *session = current_session;
+    if (session == NULL || session->sock != sock)
+        return -1;
+
+    struct epoll_event event = {.events = events | EPOLLONESHOT, .data.ptr = session};
+    if (epoll_ctl(session->reactor->epoll_fd, EPOLL_CTL_MOD, sock, &event) < 0)
+        return -1;
+    swapcontext(&session->context, &session->reactor->context);
+    return 0;
+}
+
+void reactor_stats(ReactorStats *stats)
+{
+    memset(stats, 0, sizeof(*stats));
+    stats->reactors = reactor_count;
+    for (int i = 0; i < reactor_count; i++)
+    {
+        stats->active_sessions += __atomic_load_n(&reactors[i].active_sessions, __ATOMIC_RELAXED);
+        stats->total_sessions += __atomic_load_n(&reactors[i].total_sessions, __ATOMIC_RELAXED);
+    }
+}
@@ -0,0 +1,425 @@
+#include "../includes/server.h"
+#include <dirent.h>
+#include <sys/stat.h>
+
+// The transaction log is a chain of segments. Records are appended to the active
+// segment, TRANSACTION_FILE; once it holds BANK_LEDGER_SEGMENT records the appender
+// seals it: a footer with its zone map (min/max transactionID, timestamp and account
+// number) is written after the last record, the file is renamed to
+// transactions-<first record number>.seg and made read-only. Record numbers run on
+// across segments, so the posting index addresses the whole log. Scans consult the
+// zone maps and skip segments that cannot hold a matching record.
+
+#define SEGMENT_MAGIC 0x31474553 // "SEG1"
+#define SEGMENT_PREFIX "transactions-"
+#define SEGMENT_SUFFIX ".seg"
+#define POSTINGS_SUFFIX ".pst"
+#define SEGMENT_IOV_MAX 1024 // iovecs per pwritev (Linux IOV_MAX)
+
+typedef struct
+{
+    int magic;
+    int reserved;
+    long base;
+    long count;
+    ZoneMap zone;
+} SegmentFooter;
+
+typedef struct
+{
+    long base;  // record number of the first record
+    long count; // records in the segment
+    int fd;
+    int sealed;
+    ZoneMap zone;
+} Segment;
+
+// Only the appender writes records; the table lock guards the segment list and
+// the active segment's count and zone map against concurrent readers
+static Segment *segments;
+static int segment_count;
+static int segment_capacity;
+static pthread_rwlock_t segments_lock = PTHREAD_RWLOCK_INITIALIZER;
+static long segment_records;
+
+static void zone_add(ZoneMap *zone, long count_before, const Transaction *records, long count)
+{
+    for (long i = 0; i < count; i++)
+    {
+        const Transaction *t = &records[i];
+        if (count_before + i == 0)
+        {
+            zone->min_id = zone->max_id = t->transactionID;
+            zone->min_time = zone->max_time = t->timestamp;
+            zone->min_account = zone->max_account = t->accountID;
+            continue;
+        }
+        if (t->transactionID < zone->min_id)
+            zone->min_id = t->transactionID;
+        if (t->transactionID > zone->max_id)
+            zone->max_id = t->transactionID;
+        if (t->timestamp < zone->min_time)
+            zone->min_time = t->timestamp;
+        if (t->timestamp > zone->max_time)
+            zone->max_time = t->timestamp;
+        if (t->accountID < zone->min_account)
+            zone->min_account = t->accountID;
+        if (t->accountID > zone->max_account)
+            zone->max_account = t->accountID;
+    }
+}
+
+// Recomputes a zone map from the records themselves
+static void zone_scan(int fd, long count, ZoneMap *zone)
+{
+    Transaction batch[256];
+    memset(zone, 0, sizeof(*zone));
+    for (long done = 0; done < count;)
+    {
+        long wanted = count - done < 256 ? count - done : 256;
+        ssize_t bytes = pread(fd, batch, sizeof(Transaction) * wanted, done * sizeof(Transaction));
+        if (bytes < (ssize_t)sizeof(Transaction))
+            break;
+        zone_add(zone, done, batch, bytes / sizeof(Transaction));
+        done += bytes / sizeof(Transaction);
+    }
+}
+
+// Whether a segment with this zone map can hold a record for account_no (0 = any)
+// stamped within [from, to]
+int zone_map_matches(const ZoneMap *zone, int account_no, time_t from, time_t to)
+{
+    if (zone->max_time < from || zone->min_time > to)
+        return 0;
+    return account_no == 0 || (account_no >= zone->min_account && account_no <= zone->max_account);
+}
+
+static void segment_name(char *name, size_t size, long base)
+{
+    snprintf(name, size, SEGMENT_PREFIX "%012ld" SEGMENT_SUFFIX, base);
+}
+
+// Name of the posting file kept beside a sealed segment (src/checkpoint.c)
+void segment_postings_name(char *name, size_t size, long base)
+{
+    snprintf(name, size, SEGMENT_PREFIX "%012ld" POSTINGS_SUFFIX, base);
+}
+
+static Segment *add_segment()
+{
+    if (segment_count == segment_capacity)
+    {
+        segment_capacity = segment_capacity ? segment_capacity * 2 : 16;
+        segments = realloc(segments, sizeof(Segment) * segment_capacity);
+    }
+    Segment *seg = &segments[segment_count++];
+    memset(seg, 0, sizeof(*seg));
+    return seg;
+}
+
+// Reads the footer of a sealed segment file; returns 0 if it is valid
+static int read_footer(int fd, long size, SegmentFooter *footer)
+{
+    long records_end = size - (long)sizeof(SegmentFooter);
+    if (records_end < 0 ||
+        pread(fd, footer, sizeof(*footer), records_end) != sizeof(*footer) ||
+        footer->magic != SEGMENT_MAGIC || footer->count * (long)sizeof(Transaction) != records_end)
+        return -1;
+    return 0;
+}
+
+// Makes a rename in the server's working directory (where the log lives) durable
+static int sync_directory()
+{
+    int dir_fd = open(".", O_RDONLY | O_DIRECTORY);
+    if (dir_fd < 0)
+        return -1;
+    int result = fsync(dir_fd);
+    close(dir_fd);
+    return result;
+}
+
+// Writes the footer and makes the file read-only. Called by the appender only.
+static int seal_segment(Segment *seg)
+{
+    SegmentFooter footer = {SEGMENT_MAGIC, 0, seg->base, seg->count, seg->zone};
+    if (pwrite(seg->fd, &footer, sizeof(footer), seg->count * sizeof(Transaction)) != sizeof(footer) ||
+        fdatasync(seg->fd) < 0)
+        return -1;
+
+    char name[64];
+    segment_name(name, sizeof(name), seg->base);
+    if (rename(TRANSACTION_FILE, name) < 0)
+        return -1;
+    // The rename is done, so the segment is sealed either way
+    if (sync_directory() < 0)
+        perror("Failed to sync the directory of the transaction log");
+    fchmod(seg->fd, 0444);
+    return 0;
+}
+
+static int open_active()
+{
+    int fd = open(TRANSACTION_FILE, O_RDWR | O_CREAT, 0666);
+    if (fd < 0)
+        fprintf(stderr, "Failed to open %s: %s\n", TRANSACTION_FILE, strerror(errno));
+    return fd;
+}
+
+// Seals the full active segment and starts an empty one after it
+static int rotate_segment()
+{
+    Segment *active = &segments[segment_count - 1];
+    if (seal_segment(active) < 0)
+    {
+        perror("Failed to seal transaction log segment");
+        return -1;
+    }
+    int fd = open_active();
+    if (fd < 0)
+        return -1;
+
+    // Sealed descriptors stay open: readers may still be using them
+    pthread_rwlock_wrlock(&segments_lock);
+    active = &segments[segment_count - 1];
+    active->sealed = 1;
+    long base = active->base + active->count;
+    Segment *seg = add_segment();
+    seg->base = base;
+    seg->fd = fd;
+    pthread_rwlock_unlock(&segments_lock);
+    return 0;
+}
+
+static int compare_longs(const void *a, const void *b)
+{
+    long x = *(const long *)a, y = *(const long *)b;
+    return (x > y) - (x < y);
+}
+
+static void load_sealed_segments()
+{
+    DIR *dir = opendir(".");
+    if (dir == NULL)
+        return;
+
+    long *bases = NULL;
+    int count = 0, capacity = 0;
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL)
+    {
+        long base;
+        char rest[8];
+        if (sscanf(entry->d_name, SEGMENT_PREFIX "%ld%7s", &base, rest) != 2 || strcmp(rest, SEGMENT_SUFFIX) != 0)
+            continue;
+        if (count == capacity)
+        {
+            capacity = capacity ? capacity * 2 : 16;
+            bases = realloc(bases, sizeof(long) * capacity);
+        }
+        bases[count++] = base;
+    }
+    closedir(dir);
+    qsort(bases, count, sizeof(long), compare_longs);
+
+    for (int i = 0; i < count; i++)
+    {
+        char name[64];
+        segment_name(name, sizeof(name), bases[i]);
+        int fd = open(name, O_RDONLY);
+        struct stat st;
+        if (fd < 0 || fstat(fd, &st) < 0)
+        {
+            fprintf(stderr, "Failed to open %s: %s\n", name, strerror(errno));
+            exit(EXIT_FAILURE);
+        }
+
+        Segment *seg = add_segment();
+        seg->base = bases[i];
+        seg->fd = fd;
+        seg->sealed = 1;
+        SegmentFooter footer;
+        if (read_footer(fd, st.st_size, &footer) == 0 && footer.base == bases[i])
+        {
+            seg->count = footer.count;
+            seg->zone = footer.zone;
+        }
+        else
+        {
+            seg->count = st.st_size / sizeof(Transaction);
+            zone_scan(fd, seg->count, &seg->zone);
+            printf("Rebuilt zone map of %s (no valid footer).\n", name);
+        }
+        if (segment_count > 1 && seg->base != seg[-1].base + seg[-1].count)
+            fprintf(stderr, "Warning: %s does not follow the previous segment\n", name);
+    }
+    free(bases);
+}
+
+void init_segments(int records_per_segment)
+{
+    segment_records = records_per_segment;
+    load_sealed_segments();
+
+    long base = segment_count ? segments[segment_count - 1].base + segments[segment_count - 1].count : 0;
+    int fd = open_active();
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) < 0)
+        exit(EXIT_FAILURE);
+
+    Segment *active = add_segment();
+    active->base = base;
+    active->fd = fd;
+
+    // A footer here means the server stopped between sealing and renaming
+    SegmentFooter footer;
+    int sealed = read_footer(fd, st.st_size, &footer) == 0;
+    if (sealed)
+    {
+        active->count = footer.count;
+        active->zone = footer.zone;
+    }
+    else
+    {
+        // A torn record at the end is ignored and overwritten by the next append
+        active->count = st.st_size / sizeof(Transaction);
+        zone_scan(fd, active->count, &active->zone);
+    }
+    if ((sealed || active->count >= segment_records) && rotate_segment() < 0)
+        exit(EXIT_FAILURE);
+}
+
+// Appends the records in iov (whole records, in log order), sealing segments as
+// they fill up. Only the appender calls this. Returns the first record number or -1.
+long segments_append(const struct iovec *iov, int count)
+{
+    Segment *active = &segments[segment_count - 1];
+    long first = active->base + active->count;
+    int next = 0;
+    size_t skip = 0; // bytes of iov[next] already written
+
+    while (next < count)
+    {
+        if (active->count >= segment_records)
+        {
+            if (rotate_segment() < 0)
+                return -1;
+            active = &segments[segment_count - 1];
+        }
+
+        // As much of the batch as fits in the active segment, in one pwritev
+        struct iovec part[SEGMENT_IOV_MAX];
+        size_t room = (segment_records - active->count) * sizeof(Transaction);
+        size_t bytes = 0;
+        int parts = 0;
+        for (int i = next; i < count && bytes < room && parts < SEGMENT_IOV_MAX; i++, parts++)
+        {
+            size_t offset = (i == next) ? skip : 0;
+            size_t len = iov[i].iov_len - offset;
+            if (len > room - bytes)
+                len = room - bytes;
+            part[parts].iov_base = (char *)iov[i].iov_base + offset;
+            part[parts].iov_len = len;
+            bytes += len;
+        }
+        if (pwritev(active->fd, part, parts, active->count * sizeof(Transaction)) != (ssize_t)bytes)
+            return -1;
+
+        pthread_rwlock_wrlock(&segments_lock);
+        for (int i = 0; i < parts; i++)
+        {
+            long records = part[i].iov_len / sizeof(Transaction);
+            zone_add(&active->zone, active->count, part[i].iov_base, records);
+            active->count += records;
+        }
+        pthread_rwlock_unlock(&segments_lock);
+
+        for (int i = 0; i < parts; i++)
+        {
+            if (part[i].iov_len == iov[next].iov_len - skip)
+            {
+                next++;
+                skip = 0;
+            }
+            else
+                skip += part[i].iov_len;
+        }
+    }
+    return first;
+}
+
+// Makes everything appended to the active segment durable (sealed ones already are)
+int segments_sync()
+{
+    return fdatasync(segments[segment_count - 1].fd);
+}
+
+long segments_record_count()
+{
+    pthread_rwlock_rdlock(&segments_lock);
+    Segment *active = &segments[segment_count - 1];
+    long count = active->base + active->count;
+    pthread_rwlock_unlock(&segments_lock);
+    return count;
+}
+
+// Reads up to count records starting at record_no, stopping at the end of its
+// segment; returns how many were read
+int segments_read(long record_no, Transaction *records, int count)
+{
+    int fd = -1;
+    long local = 0;
+    pthread_rwlock_rdlock(&segments_lock);
+    int lo = 0, hi = segment_count;
+    while (lo < hi)
+    {
+        int mid = lo + (hi - lo) / 2;
+        if (segments[mid].base <= record_no)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    if (lo > 0 && record_no < segments[lo - 1].base + segments[lo - 1].count)
+    {
+        Segment *seg = &segments[lo - 1];
+        fd = seg->fd;
+        local = record_no - seg->base;
+        if (count > seg->count - local)
+            count = seg->count - local;
+    }
+    pthread_rwlock_unlock(&segments_lock);
+
+    if (fd < 0 || count <= 0)
+        return 0;
+    ssize_t bytes = pread(fd, records, sizeof(Transaction) * count, local * sizeof(Transaction));
+    return bytes < 0 ? 0 : bytes / sizeof(Transaction);
+}
+
+// Describes segment index (0 = oldest); returns -1 past the active segment
+int segments_info(int index, SegmentInfo *info)
+{
+    int found = -1;
+    pthread_rwlock_rdlock(&segments_lock);
+    if (index >= 0 && index < segment_count)
+    {
+        info->base = segments[index].base;
+        info->count = segments[index].count;
+        info->sealed = segments[index].sealed;
+        info->zone = segments[index].zone;
+        found = 0;
+    }
+    pthread_rwlock_unlock(&segments_lock);
+    return found;
+}
+
+// Highest transactionID in the log, or 0 if it is empty
+long segments_last_id()
+{
+    long id = 0;
+    pthread_rwlock_rdlock(&segments_lock);
+    for (int i = 0; i < segment_count; i++)
+        if (segments[i].count > 0 && segments[i].zone.max_id > id)
+            id = segments[i].zone.max_id;
+    pthread_rwlock_unlock(&segments_lock);
+    return id;
+}
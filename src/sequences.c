@@ -0,0 +1,89 @@
+#include "../includes/server.h"
+#include <stddef.h>
+
+// Next-ID counters persisted in SEQUENCE_FILE so allocation never scans a data file.
+// IDs are taken under the data file's append lock, so the highest ID in each index
+// is the newest record. The sidecar is not synced; at startup each counter is
+// raised to follow that highest ID, which covers a sidecar that is missing,
+// corrupt, lost its last writes in a crash or was restored from an old backup.
+static SequenceHeader seq_header;
+static int seq_fd = -1;
+static pthread_mutex_t seq_persist_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// The transaction log is segmented; its zone maps already hold the highest ID
+static const char *seq_files[SEQ_COUNT] = {USER_INDEX_FILE, ACCOUNT_INDEX_FILE, LOAN_INDEX_FILE, "transaction log zone maps"};
+static const DataFile seq_data[SEQ_COUNT - 1] = {DATA_USERS, DATA_ACCOUNTS, DATA_LOANS};
+static const char *seq_names[SEQ_COUNT] = {"user", "account", "loan", "transaction"};
+
+static long scan_next_id(SequenceType type, int fd)
+{
+    switch (type)
+    {
+    case SEQ_USER:
+        return get_next_user_id(fd);
+    case SEQ_ACCOUNT:
+        return get_next_account_no(fd);
+    case SEQ_LOAN:
+        return get_next_loan_id(fd);
+    default:
+        return segments_last_id() + 1;
+    }
+}
+
+static void recover_sequence(SequenceType type, int header_valid)
+{
+    int fd = (type == SEQ_TRANSACTION) ? -1 : data_fd(seq_data[type]);
+    long next = scan_next_id(type, fd);
+    if (!header_valid || next > seq_header.next[type])
+    {
+        seq_header.next[type] = next;
+        printf("Rebuilt %s sequence from %s (next = %ld).\n", seq_names[type], seq_files[type], next);
+    }
+}
+
+void init_sequences()
+{
+    seq_fd = open(SEQUENCE_FILE, O_RDWR | O_CREAT, 0666);
+    if (seq_fd < 0)
+    {
+        perror("Failed to open sequence file");
+        exit(EXIT_FAILURE);
+    }
+
+    int header_valid = pread(seq_fd, &seq_header, sizeof(seq_header), 0) == sizeof(seq_header) &&
+                       seq_header.magic == SEQUENCE_MAGIC;
+    if (!header_valid)
+    {
+        memset(&seq_header, 0, sizeof(seq_header));
+        seq_header.magic = SEQUENCE_MAGIC;
+    }
+
+    for (int type = 0; type < SEQ_COUNT; type++)
+        recover_sequence((SequenceType)type, header_valid);
+
+    if (pwrite(seq_fd, &seq_header, sizeof(seq_header), 0) != sizeof(seq_header) || fdatasync(seq_fd) < 0)
+        perror("Failed to write sequence file");
+}
+
+// Writes the current value (not the caller's) so the file never moves backwards
+static void persist_sequence(SequenceType type)
+{
+    pthread_mutex_lock(&seq_persist_lock);
+    long value = __atomic_load_n(&seq_header.next[type], __ATOMIC_SEQ_CST);
+    if (pwrite(seq_fd, &value, sizeof(long), offsetof(SequenceHeader, next) + type * sizeof(long)) != sizeof(long))
+        perror("Failed to persist sequence");
+    pthread_mutex_unlock(&seq_persist_lock);
+}
+
+long next_sequence_id(SequenceType type)
+{
+    return reserve_sequence_ids(type, 1);
+}
+
+// Reserves count consecutive IDs with a single sidecar write; returns the first
+long reserve_sequence_ids(SequenceType type, int count)
+{
+    long id = __atomic_fetch_add(&seq_header.next[type], count, __ATOMIC_SEQ_CST);
+    persist_sequence(type);
+    return id;
+}
@@ -0,0 +1,153 @@
+#include "../includes/server.h"
+
+// Set of logged-in userIDs enforcing one session per user. Users are spread over
+// mutex-guarded shards, each an open-addressing table (-1 = empty slot) that uses
+// backward-shift deletion, so claim and release are O(1) and contention is 1/shards.
+
+#define REGISTRY_SHARDS 64
+#define REGISTRY_SHARD_INITIAL_CAPACITY 16
+
+typedef struct
+{
+    pthread_mutex_t lock;
+    int *slots;
+    int capacity;
+    int count;
+} RegistryShard;
+
+static RegistryShard shards[REGISTRY_SHARDS];
+static int max_logins;
+static int active_logins;
+
+static unsigned int hash_user(int userID)
+{
+    unsigned int h = (unsigned int)userID * 0x9E3779B1u;
+    return h ^ (h >> 15);
+}
+
+static RegistryShard *shard_for(int userID)
+{
+    return &shards[hash_user(userID) % REGISTRY_SHARDS];
+}
+
+// Probe position inside a shard; uses different hash bits than shard_for
+static unsigned int slot_for(RegistryShard *shard, int userID)
+{
+    return (hash_user(userID) / REGISTRY_SHARDS) & (shard->capacity - 1);
+}
+
+static void shard_grow(RegistryShard *shard)
+{
+    int old_capacity = shard->capacity;
+    int *old_slots = shard->slots;
+
+    shard->capacity = old_capacity * 2;
+    shard->slots = malloc(sizeof(int) * shard->capacity);
+    for (int i = 0; i < shard->capacity; i++)
+        shard->slots[i] = -1;
+
+    for (int i = 0; i < old_capacity; i++)
+    {
+        if (old_slots[i] == -1)
+            continue;
+        unsigned int pos = slot_for(shard, old_slots[i]);
+        while (shard->slots[pos] != -1)
+            pos = (pos + 1) & (shard->capacity - 1);
+        shard->slots[pos] = old_slots[i];
+    }
+    free(old_slots);
+}
+
+void init_session_registry(int capacity)
+{
+    max_logins = capacity;
+    active_logins = 0;
+    for (int i = 0; i < REGISTRY_SHARDS; i++)
+    {
+        pthread_mutex_init(&shards[i].lock, NULL);
+        shards[i].capacity = REGISTRY_SHARD_INITIAL_CAPACITY;
+        shards[i].count = 0;
+        shards[i].slots = malloc(sizeof(int) * shards[i].capacity);
+        for (int j = 0; j < shards[i].capacity; j++)
+            shards[i].slots[j] = -1;
+    }
+}
+
+// Returns LOGIN_OK, LOGIN_DUPLICATE or LOGIN_FULL
+int claim_login(int userID)
+{
+    RegistryShard *shard = shard_for(userID);
+    pthread_mutex_lock(&shard->lock);
+
+    unsigned int pos = slot_for(shard, userID);
+    while (shard->slots[pos] != -1)
+    {
+        if (shard->slots[pos] == userID)
+        {
+            pthread_mutex_unlock(&shard->lock);
+            return LOGIN_DUPLICATE;
+        }
+        pos = (pos + 1) & (shard->capacity - 1);
+    }
+
+    if (__atomic_add_fetch(&active_logins, 1, __ATOMIC_SEQ_CST) > max_logins)
+    {
+        __atomic_sub_fetch(&active_logins, 1, __ATOMIC_SEQ_CST);
+        pthread_mutex_unlock(&shard->lock);
+        return LOGIN_FULL;
+    }
+
+    if ((shard->count + 1) * 4 > shard->capacity * 3)
+    {
+        shard_grow(shard);
+        pos = slot_for(shard, userID);
+        while (shard->slots[pos] != -1)
+            pos = (pos + 1) & (shard->capacity - 1);
+    }
+    shard->slots[pos] = userID;
+    shard->count++;
+    pthread_mutex_unlock(&shard->lock);
+    return LOGIN_OK;
+}
+
+void release_login(int userID)
+{
+    RegistryShard *shard = shard_for(userID);
+    pthread_mutex_lock(&shard->lock);
+
+    unsigned int mask = shard->capacity - 1;
+    unsigned int pos = slot_for(shard, userID);
+    while (shard->slots[pos] != -1 && shard->slots[pos] != userID)
+        pos = (pos + 1) & mask;
+
+    if (shard->slots[pos] == userID)
+    {
+        // Shift later members of the probe run back so lookups never hit a hole
+        unsigned int hole = pos;
+        unsigned int next = (pos + 1) & mask;
+        while (shard->slots[next] != -1)
+        {
+            unsigned int home = slot_for(shard, shard->slots[next]);
+            if (((next - home) & mask) >= ((next - hole) & mask))
+            {
+                shard->slots[hole] = shard->slots[next];
+                hole = next;
+            }
+            next = (next + 1) & mask;
+        }
+        shard->slots[hole] = -1;
+        shard->count--;
+        __atomic_sub_fetch(&active_logins, 1, __ATOMIC_SEQ_CST);
+    }
+    pthread_mutex_unlock(&shard->lock);
+}
+
+int active_login_count()
+{
+    return __atomic_load_n(&active_logins, __ATOMIC_SEQ_CST);
+}
+
+int login_capacity()
+{
+    return max_logins;
+}
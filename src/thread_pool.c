@@ -0,0 +1,126 @@
+#include "../includes/server.h"
+#include <stdint.h>
+
+// Fixed pool of workers fed accepted sockets through a bounded ring queue
+static struct
+{
+    pthread_mutex_t lock;
+    pthread_cond_t not_empty;
+    pthread_cond_t not_full;
+    int *queue;
+    int capacity;
+    int head;
+    int count;
+    int peak_count;
+    pthread_t *workers;
+    int worker_count;
+    struct timespec *busy_since; // per worker, tv_sec == 0 while idle
+    int busy_workers;
+    long served;
+    long full_waits;
+    struct timespec started;
+    double busy_seconds; // finished sessions summed over all workers
+} pool;
+
+static double elapsed_seconds(const struct timespec *from, const struct timespec *to)
+{
+    return (to->tv_sec - from->tv_sec) + (to->tv_nsec - from->tv_nsec) / 1e9;
+}
+
+static void *worker_main(void *arg)
+{
+    int id = (int)(intptr_t)arg;
+    while (1)
+    {
+        pthread_mutex_lock(&pool.lock);
+        while (pool.count == 0)
+            pthread_cond_wait(&pool.not_empty, &pool.lock);
+
+        int sock = pool.queue[pool.head];
+        pool.head = (pool.head + 1) % pool.capacity;
+        pool.count--;
+        pool.busy_workers++;
+        clock_gettime(CLOCK_MONOTONIC, &pool.busy_since[id]);
+        pthread_cond_signal(&pool.not_full);
+        pthread_mutex_unlock(&pool.lock);
+
+        handle_client(sock);
+
+        struct timespec end;
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        pthread_mutex_lock(&pool.lock);
+        pool.busy_workers--;
+        pool.served++;
+        pool.busy_seconds += elapsed_seconds(&pool.busy_since[id], &end);
+        pool.busy_since[id].tv_sec = 0;
+        pthread_mutex_unlock(&pool.lock);
+    }
+    return NULL;
+}
+
+void thread_pool_start(int worker_count, int capacity)
+{
+    pthread_mutex_init(&pool.lock, NULL);
+    pthread_cond_init(&pool.not_empty, NULL);
+    pthread_cond_init(&pool.not_full, NULL);
+    pool.queue = malloc(sizeof(int) * capacity);
+    pool.capacity = capacity;
+    pool.workers = malloc(sizeof(pthread_t) * worker_count);
+    pool.busy_since = calloc(worker_count, sizeof(struct timespec));
+    clock_gettime(CLOCK_MONOTONIC, &pool.started);
+
+    for (int i = 0; i < worker_count; i++)
+    {
+        if (pthread_create(&pool.workers[i], NULL, worker_main, (void *)(intptr_t)i) != 0)
+        {
+            perror("pthread_create failed");
+            break;
+        }
+        pool.worker_count++;
+    }
+    if (pool.worker_count == 0)
+    {
+        fprintf(stderr, "Could not start any worker threads.\n");
+        exit(EXIT_FAILURE);
+    }
+}
+
+// Blocks while the queue is full so the listen backlog absorbs the burst
+void thread_pool_submit(int sock)
+{
+    pthread_mutex_lock(&pool.lock);
+    while (pool.count == pool.capacity)
+    {
+        pool.full_waits++;
+        pthread_cond_wait(&pool.not_full, &pool.lock);
+    }
+    pool.queue[(pool.head + pool.count) % pool.capacity] = sock;
+    pool.count++;
+    if (pool.count > pool.peak_count)
+        pool.peak_count = pool.count;
+    pthread_cond_signal(&pool.not_empty);
+    pthread_mutex_unlock(&pool.lock);
+}
+
+void thread_pool_stats(PoolStats *stats)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    pthread_mutex_lock(&pool.lock);
+    stats->workers = pool.worker_count;
+    stats->busy_workers = pool.busy_workers;
+    stats->queue_depth = pool.count;
+    stats->queue_capacity = pool.capacity;
+    stats->peak_queue_depth = pool.peak_count;
+    stats->served = pool.served;
+    stats->full_waits = pool.full_waits;
+
+    double busy = pool.busy_seconds;
+    for (int i = 0; i < pool.worker_count; i++)
+        if (pool.busy_since[i].tv_sec != 0)
+            busy += elapsed_seconds(&pool.busy_since[i], &now);
+    double uptime = elapsed_seconds(&pool.started, &now);
+    stats->utilization = uptime > 0 ? busy / (uptime * pool.worker_count) : 0;
+    pthread_mutex_unlock(&pool.lock);
+}
@@ -1,215 +1,320 @@
 #include "../includes/server.h"
 
+// Appends one record and waits until the ledger appender has written it
 void log_transaction(int accountID, TransactionType type, float amount, float oldBalance, float newBalance)
 {
-    int fd = open(TRANSACTION_FILE, O_RDWR | O_CREAT, 0666);
-    if (fd < 0)
-    {
-        perror("Failed to open transaction log");
-        return;
-    }
-
-    struct flock lock;
-    memset(&lock, 0, sizeof(lock));
-    lock.l_type = F_WRLCK;
-    lock.l_whence = SEEK_SET;
-    lock.l_start = 0;
-    lock.l_len = 0;
-    fcntl(fd, F_SETLKW, &lock);
-
-    long next_trans_id = get_next_transaction_id(fd);
-
-    Transaction trans = {
-        .transactionID = next_trans_id,
-        .accountID = accountID,
-        .type = type,
-        .amount = amount,
-        .oldBalance = oldBalance,
-        .newBalance = newBalance,
-        .timestamp = time(NULL)};
-
-    lseek(fd, 0, SEEK_END);
-    write(fd, &trans, sizeof(Transaction));
-
-    lock.l_type = F_UNLCK;
-    fcntl(fd, F_SETLK, &lock);
-    close(fd);
+    LedgerEntry entry;
+    ledger_submit(&entry, accountID, type, amount, oldBalance, newBalance);
+    ledger_wait(&entry);
 }
 
 int transfer_funds(int sock, int from_account, int to_account, float amount)
 {
-    if (amount <= 0)
-    {
+    int result = account_transfer(from_account, to_account, amount);
+    if (result == ACC_INVALID)
         write_to_client(sock, "Invalid transfer amount.\n");
-        return -1;
-    }
-
-    int fd = open(ACCOUNT_FILE, O_RDWR);
-    if (fd < 0)
-    {
+    else if (result == ACC_NOT_FOUND)
+        write_to_client(sock, "Error: One or both accounts not found.\n");
+    else if (result == ACC_INACTIVE)
+        write_to_client(sock, "Error: One or both accounts are deactivated.\n");
+    else if (result == ACC_INSUFFICIENT)
+        write_to_client(sock, "Error: Insufficient balance for transfer.\n");
+    else if (result != ACC_OK)
         write_to_client(sock, "Error: Cannot access account data.\n");
+    if (result != ACC_OK)
         return -1;
-    }
 
-    // Find both accounts
-    long from_offset = find_account_offset(fd, from_account);
-    long to_offset = find_account_offset(fd, to_account);
+    char buffer[1024];
+    sprintf(buffer, "Successfully transferred %.2f from account %d to account %d.\n", 
+            amount, from_account, to_account);
+    write_to_client(sock, buffer);
+    return 0;
+}
 
-    if (from_offset == -1 || to_offset == -1)
-    {
-        write_to_client(sock, "Error: One or both accounts not found.\n");
-        close(fd);
+#define HISTORY_CHUNK 64
+
+static long transaction_id_at(int account_no, int pos)
+{
+    long record_no;
+    Transaction trans;
+    if (posting_range(&transaction_index, account_no, pos, 1, &record_no) != 1 ||
+        segments_read(record_no, &trans, 1) != 1)
         return -1;
+    return trans.transactionID;
+}
+
+// First position in the account's history with transactionID above id
+static int position_after(int account_no, int count, long id)
+{
+    int lo = 0, hi = count;
+    while (lo < hi)
+    {
+        int mid = lo + (hi - lo) / 2;
+        if (transaction_id_at(account_no, mid) <= id)
+            lo = mid + 1;
+        else
+            hi = mid;
     }
+    return lo;
+}
 
-    // Lock both accounts (in order of offset to prevent deadlocks)
-    struct flock lock1, lock2;
-    memset(&lock1, 0, sizeof(lock1));
-    memset(&lock2, 0, sizeof(lock2));
+static const char *transaction_type_name(TransactionType type)
+{
+    if (type == DEPOSIT)
+        return "DEPOSIT";
+    if (type == WITHDRAWAL)
+        return "WITHDRAWAL";
+    if (type == LOAN_DEPOSIT)
+        return "LOAN_DEPOSIT";
+    return "TRANSFER";
+}
 
-    lock1.l_type = F_WRLCK;
-    lock1.l_whence = SEEK_SET;
-    lock1.l_start = (from_offset < to_offset) ? from_offset : to_offset;
-    lock1.l_len = sizeof(Account);
+static void print_transaction_header(OutBuf *out, int with_account)
+{
+    outbuf_printf(out, with_account ? "ID    | Account | Type         | Amount   | Old Bal  | New Bal  | Date & Time\n"
+                                    : "ID    | Type         | Amount   | Old Bal  | New Bal  | Date & Time\n");
+    outbuf_printf(out, "----------------------------------------------------------------------------------\n");
+}
 
-    lock2.l_type = F_WRLCK;
-    lock2.l_whence = SEEK_SET;
-    lock2.l_start = (from_offset < to_offset) ? to_offset : from_offset;
-    lock2.l_len = sizeof(Account);
+static void print_transaction_row(OutBuf *out, const Transaction *trans, int with_account)
+{
+    struct tm tm_buf;
+    char time_buf[30];
+    strftime(time_buf, sizeof(time_buf), "%Y-%m-%d %H:%M:%S", localtime_r(&trans->timestamp, &tm_buf));
+    if (with_account)
+        outbuf_printf(out, "%-5ld | %-7d ", trans->transactionID, trans->accountID);
+    else
+        outbuf_printf(out, "%-5ld ", trans->transactionID);
+    outbuf_printf(out, "| %-12s | %-9.2f | %-9.2f | %-9.2f | %s\n",
+                  transaction_type_name(trans->type),
+                  trans->amount,
+                  trans->oldBalance,
+                  trans->newBalance,
+                  time_buf);
+}
 
-    // Acquire locks
-    if (fcntl(fd, F_SETLKW, &lock1) == -1 || fcntl(fd, F_SETLKW, &lock2) == -1)
+// Send one page of history; returns the last ID shown, -1 at the end
+long view_transactions(int sock, int account_no, int page_size, long cursor, int newest_first)
+{
+    int count = posting_count(&transaction_index, account_no);
+    int step = newest_first ? -1 : 1;
+    int pos;
+    if (cursor < 0)
+        pos = newest_first ? count - 1 : 0;
+    else
+        pos = newest_first ? position_after(account_no, count, cursor - 1) - 1
+                           : position_after(account_no, count, cursor);
+
+    OutBuf *out = malloc(sizeof(OutBuf));
+    outbuf_init(out, sock);
+    outbuf_printf(out, "\n--- Transaction History for Account %d ---\n", account_no);
+    print_transaction_header(out, 0);
+
+    // Rows are indexed once fully written, so no file lock
+    long records[HISTORY_CHUNK];
+    long last_id = -1;
+    int shown = 0;
+    while (pos >= 0 && pos < count && (page_size <= 0 || shown < page_size))
     {
-        write_to_client(sock, "Error: Cannot lock accounts for transfer.\n");
-        close(fd);
-        return -1;
+        int first = newest_first ? (pos - HISTORY_CHUNK + 1 > 0 ? pos - HISTORY_CHUNK + 1 : 0) : pos;
+        int fetched = posting_range(&transaction_index, account_no, first, HISTORY_CHUNK, records);
+        if (fetched == 0)
+            break;
+
+        for (int i = pos - first; i >= 0 && i < fetched && (page_size <= 0 || shown < page_size); i += step, pos += step)
+        {
+            Transaction trans;
+            if (segments_read(records[i], &trans, 1) != 1 || trans.accountID != account_no)
+                continue;
+
+            print_transaction_row(out, &trans, 0);
+            last_id = trans.transactionID;
+            shown++;
+        }
     }
 
-    // Read accounts
-    Account from_acc, to_acc;
-    lseek(fd, from_offset, SEEK_SET);
-    read(fd, &from_acc, sizeof(Account));
-    lseek(fd, to_offset, SEEK_SET);
-    read(fd, &to_acc, sizeof(Account));
+    if (shown == 0)
+        outbuf_printf(out, cursor < 0 ? "No transactions found for this account.\n" : "No more transactions.\n");
+    outbuf_flush(out);
+    free(out);
+
+    int more = newest_first ? pos >= 0 : pos < count;
+    return (more && shown > 0) ? last_id : -1;
+}
 
-    // Check account status
-    if (!from_acc.is_active || !to_acc.is_active)
+// Menu view: newest first, one page at a time
+void browse_transactions(int sock, int account_no)
+{
+    char buffer[64];
+    long cursor = view_transactions(sock, account_no, TRANSACTION_PAGE_SIZE, -1, 1);
+    while (cursor != -1)
     {
-        write_to_client(sock, "Error: One or both accounts are deactivated.\n");
-        lock1.l_type = F_UNLCK;
-        lock2.l_type = F_UNLCK;
-        fcntl(fd, F_SETLK, &lock1);
-        fcntl(fd, F_SETLK, &lock2);
-        close(fd);
-        return -1;
+        write_to_client(sock, "Enter n for older transactions, anything else to go back: ");
+        if (read_from_client(sock, buffer, sizeof(buffer)) <= 0 || strcmp(buffer, "n") != 0)
+            break;
+        cursor = view_transactions(sock, account_no, TRANSACTION_PAGE_SIZE, cursor, 1);
     }
+}
 
-    // Check sufficient balance
-    if (from_acc.balance < amount)
+// First record in the segment stamped at or after t
+static long first_record_since(const SegmentInfo *seg, time_t t)
+{
+    long lo = seg->base, hi = seg->base + seg->count;
+    while (lo < hi)
     {
-        write_to_client(sock, "Error: Insufficient balance for transfer.\n");
-        lock1.l_type = F_UNLCK;
-        lock2.l_type = F_UNLCK;
-        fcntl(fd, F_SETLK, &lock1);
-        fcntl(fd, F_SETLK, &lock2);
-        close(fd);
-        return -1;
+        long mid = lo + (hi - lo) / 2;
+        Transaction trans;
+        if (segments_read(mid, &trans, 1) != 1)
+            return seg->base + seg->count;
+        if (trans.timestamp < t)
+            lo = mid + 1;
+        else
+            hi = mid;
     }
-
-    // Perform transfer
-    float from_old_bal = from_acc.balance;
-    float to_old_bal = to_acc.balance;
-
-    from_acc.balance -= amount;
-    to_acc.balance += amount;
-
-    // Write back updated accounts
-    lseek(fd, from_offset, SEEK_SET);
-    write(fd, &from_acc, sizeof(Account));
-    lseek(fd, to_offset, SEEK_SET);
-    write(fd, &to_acc, sizeof(Account));
-
-    // Log transactions for both accounts
-    log_transaction(from_acc.account_no, TRANSFER_SENT, amount, from_old_bal, from_acc.balance);
-    log_transaction(to_acc.account_no, TRANSFER_RECEIVED, amount, to_old_bal, to_acc.balance);
-
-    // Release locks
-    lock1.l_type = F_UNLCK;
-    lock2.l_type = F_UNLCK;
-    fcntl(fd, F_SETLK, &lock1);
-    fcntl(fd, F_SETLK, &lock2);
-    close(fd);
-
-    char buffer[1024];
-    sprintf(buffer, "Successfully transferred %.2f from account %d to account %d.\n", 
-            amount, from_account, to_account);
-    write_to_client(sock, buffer);
-    return 0;
+    return lo;
 }
 
-void view_transactions(int sock, int account_no)
+// Same search within one account's posting list
+static int first_position_since(int account_no, int count, time_t t)
 {
-    int fd = open(TRANSACTION_FILE, O_RDONLY);
-    if (fd < 0)
+    int lo = 0, hi = count;
+    while (lo < hi)
     {
-        write_to_client(sock, "Error: Cannot open transaction history.\n");
-        return;
+        int mid = lo + (hi - lo) / 2;
+        long record_no;
+        Transaction trans;
+        if (posting_range(&transaction_index, account_no, mid, 1, &record_no) != 1 ||
+            segments_read(record_no, &trans, 1) != 1)
+            return count;
+        if (trans.timestamp < t)
+            lo = mid + 1;
+        else
+            hi = mid;
     }
+    return lo;
+}
 
-    struct flock lock;
-    memset(&lock, 0, sizeof(lock));
-    lock.l_type = F_RDLCK;
-    lock.l_start = 0;
-    lock.l_len = 0;
-    fcntl(fd, F_SETLKW, &lock);
-
-    Transaction trans;
-    char buffer[8192] = {0};
-    char line[512];
-    int found = 0;
-
-    sprintf(line, "\n--- Transaction History for Account %d ---\n", account_no);
-    strcat(buffer, line);
-    strcat(buffer, "ID    | Type         | Amount   | Old Bal  | New Bal  | Date & Time\n");
-    strcat(buffer, "----------------------------------------------------------------------------------\n");
-
-    while (read(fd, &trans, sizeof(Transaction)) == sizeof(Transaction))
+// Send transactions in [from, to]; account_no 0 means all accounts
+void view_transactions_between(int sock, int account_no, time_t from, time_t to)
+{
+    OutBuf *out = malloc(sizeof(OutBuf));
+    outbuf_init(out, sock);
+    if (account_no == 0)
+        outbuf_printf(out, "\n--- All Transactions ---\n");
+    else
+        outbuf_printf(out, "\n--- Transactions for Account %d ---\n", account_no);
+    print_transaction_header(out, account_no == 0);
+
+    long shown = 0;
+    if (account_no == 0)
     {
-        if (trans.accountID == account_no)
+        Transaction *batch = malloc(sizeof(Transaction) * HISTORY_CHUNK);
+        SegmentInfo seg;
+        int in_range = 1;
+        for (int s = 0; in_range && segments_info(s, &seg) == 0; s++)
         {
-            found = 1;
-            char type_str[20];
-            if (trans.type == DEPOSIT)
-                strcpy(type_str, "DEPOSIT");
-            else if (trans.type == WITHDRAWAL)
-                strcpy(type_str, "WITHDRAWAL");
-            else if (trans.type == LOAN_DEPOSIT)
-                strcpy(type_str, "LOAN_DEPOSIT");
-            else
-                strcpy(type_str, "TRANSFER");
-
-            char time_buf[30];
-            strftime(time_buf, sizeof(time_buf), "%Y-%m-%d %H:%M:%S", localtime(&trans.timestamp));
-
-            sprintf(line, "%-5ld | %-12s | %-9.2f | %-9.2f | %-9.2f | %s\n",
-                    trans.transactionID,
-                    type_str,
-                    trans.amount,
-                    trans.oldBalance,
-                    trans.newBalance,
-                    time_buf);
-            strcat(buffer, line);
+            if (seg.count == 0 || !zone_map_matches(&seg.zone, 0, from, to))
+            {
+                in_range = seg.count == 0 || seg.zone.min_time <= to; // later segments are newer
+                continue;
+            }
+            long end = seg.base + seg.count;
+            long next = seg.zone.min_time < from ? first_record_since(&seg, from) : seg.base;
+            while (in_range && next < end)
+            {
+                int fetched = segments_read(next, batch, end - next < HISTORY_CHUNK ? end - next : HISTORY_CHUNK);
+                if (fetched == 0)
+                    break;
+                for (int i = 0; i < fetched && in_range; i++)
+                {
+                    in_range = batch[i].timestamp <= to;
+                    if (in_range)
+                    {
+                        print_transaction_row(out, &batch[i], 1);
+                        shown++;
+                    }
+                }
+                next += fetched;
+            }
         }
+        free(batch);
     }
-
-    if (!found)
+    else
     {
-        strcat(buffer, "No transactions found for this account.\n");
+        int count = posting_count(&transaction_index, account_no);
+        long records[HISTORY_CHUNK];
+        int pos = first_position_since(account_no, count, from);
+        int in_range = 1;
+        while (in_range && pos < count)
+        {
+            int fetched = posting_range(&transaction_index, account_no, pos, HISTORY_CHUNK, records);
+            if (fetched == 0)
+                break;
+            for (int i = 0; i < fetched && in_range; i++)
+            {
+                Transaction trans;
+                if (segments_read(records[i], &trans, 1) != 1 || trans.accountID != account_no)
+                    continue;
+                in_range = trans.timestamp <= to;
+                if (in_range)
+                {
+                    print_transaction_row(out, &trans, 0);
+                    shown++;
+                }
+            }
+            pos += fetched;
+        }
     }
 
-    lock.l_type = F_UNLCK;
-    fcntl(fd, F_SETLK, &lock);
-    close(fd);
+    if (shown == 0)
+        outbuf_printf(out, "No transactions in this period.\n");
+    else
+        outbuf_printf(out, "%ld transaction(s).\n", shown);
+    outbuf_flush(out);
+    free(out);
+}
 
-    write_to_client(sock, buffer);
+// Reads a YYYY-MM-DD date as local midnight; returns -1 if it does not parse
+static time_t read_date(int sock, const char *prompt)
+{
+    char buffer[64];
+    write_to_client(sock, prompt);
+    if (read_from_client(sock, buffer, sizeof(buffer)) <= 0)
+        return -1;
+
+    struct tm tm_buf;
+    memset(&tm_buf, 0, sizeof(tm_buf));
+    char extra;
+    if (sscanf(buffer, "%d-%d-%d%c", &tm_buf.tm_year, &tm_buf.tm_mon, &tm_buf.tm_mday, &extra) != 3 ||
+        tm_buf.tm_mon < 1 || tm_buf.tm_mon > 12 || tm_buf.tm_mday < 1 || tm_buf.tm_mday > 31)
+        return -1;
+    tm_buf.tm_year -= 1900;
+    tm_buf.tm_mon -= 1;
+    tm_buf.tm_isdst = -1;
+    return mktime(&tm_buf);
+}
+
+// Menu view: statement or audit extract between two dates, both inclusive
+void browse_transactions_by_date(int sock)
+{
+    char buffer[64];
+    write_to_client(sock, "Enter account number (0 for all accounts): ");
+    if (read_from_client(sock, buffer, sizeof(buffer)) <= 0)
+        return;
+    int account_no = atoi(buffer);
+
+    time_t from = read_date(sock, "From date (YYYY-MM-DD): ");
+    time_t to = read_date(sock, "To date (YYYY-MM-DD): ");
+    if (from == -1 || to == -1 || to < from)
+    {
+        write_to_client(sock, "Invalid date range.\n");
+        return;
+    }
+
+    // The end date is inclusive: stop at the last second of that day
+    struct tm tm_buf;
+    localtime_r(&to, &tm_buf);
+    tm_buf.tm_mday++;
+    tm_buf.tm_isdst = -1;
+    view_transactions_between(sock, account_no, from, mktime(&tm_buf) - 1);
 }
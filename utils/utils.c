@@ -1,17 +1,240 @@
 #include "../includes/server.h"
+#include <poll.h>
+#include <stdarg.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
 
-// read the data from client
-int read_from_client(int sock, char *buffer, int size)
+// Per-connection input buffers, indexed by socket. A socket belongs to exactly one
+// session at a time, so each buffer is only touched by the session that owns it.
+typedef struct
 {
-    memset(buffer, 0, size);
-    int bytes_read = read(sock, buffer, size - 1);
+    char data[CLIENT_BUFFER_SIZE];
+    int start; // first unconsumed byte
+    int end;   // one past the last received byte
+} ClientBuffer;
+
+static ClientBuffer **client_buffers;
+static int client_buffer_slots;
+
+void init_client_buffers()
+{
+    struct rlimit limit;
+    if (getrlimit(RLIMIT_NOFILE, &limit) < 0 || limit.rlim_cur == RLIM_INFINITY || limit.rlim_cur > 1 << 20)
+        limit.rlim_cur = 1 << 20;
+    client_buffer_slots = (int)limit.rlim_cur;
+    client_buffers = calloc(client_buffer_slots, sizeof(ClientBuffer *));
+}
+
+static ClientBuffer *buffer_for(int sock)
+{
+    if (sock < 0 || sock >= client_buffer_slots)
+        return NULL;
+    if (client_buffers[sock] == NULL)
+        client_buffers[sock] = calloc(1, sizeof(ClientBuffer));
+    return client_buffers[sock];
+}
+
+// Drops bytes left over from an earlier connection that used the same descriptor
+void reset_client_buffer(int sock)
+{
+    ClientBuffer *in = buffer_for(sock);
+    if (in)
+        in->start = in->end = 0;
+}
+
+// Blocks (or parks the reactor session) until sock is ready
+static void wait_for_socket(int sock, int want_write)
+{
+    if (session_wait(sock, want_write ? EPOLLOUT : EPOLLIN) == 0)
+        return;
+    struct pollfd pfd = {.fd = sock, .events = want_write ? POLLOUT : POLLIN};
+    poll(&pfd, 1, -1);
+}
+
+static void compact_client_buffer(ClientBuffer *in)
+{
+    if (in->start > 0)
+    {
+        memmove(in->data, in->data + in->start, in->end - in->start);
+        in->end -= in->start;
+        in->start = 0;
+    }
+}
+
+// Reads whatever the client has sent into the free space of its buffer
+static int fill_client_buffer(int sock, ClientBuffer *in)
+{
+    compact_client_buffer(in);
+    if (in->end == CLIENT_BUFFER_SIZE)
+        return 0;
+
+    int bytes_read;
+    while ((bytes_read = read(sock, in->data + in->end, CLIENT_BUFFER_SIZE - in->end)) < 0)
+    {
+        if (errno == EAGAIN)
+            wait_for_socket(sock, 0);
+        else if (errno != EINTR)
+            break;
+    }
     if (bytes_read > 0)
-        buffer[strcspn(buffer, "\r\n")] = 0;
+        in->end += bytes_read;
     return bytes_read;
 }
 
+// read one line from the client; returns the bytes consumed, or <= 0 on disconnect
+int read_from_client(int sock, char *buffer, int size)
+{
+    memset(buffer, 0, size);
+    ClientBuffer *in = buffer_for(sock);
+    if (in == NULL)
+        return -1;
+
+    char *newline;
+    while ((newline = memchr(in->data + in->start, '\n', in->end - in->start)) == NULL)
+    {
+        int bytes_read = fill_client_buffer(sock, in);
+        if (bytes_read == 0 && in->end == CLIENT_BUFFER_SIZE)
+            break; // line longer than the buffer: hand over what we have
+        if (bytes_read <= 0)
+        {
+            if (in->end == in->start)
+                return bytes_read;
+            break; // unterminated last line before disconnect
+        }
+    }
+
+    int line_end = newline ? (int)(newline - in->data) : in->end;
+    int consumed = (newline ? line_end + 1 : line_end) - in->start;
+    int length = line_end - in->start;
+    if (length > size - 1)
+        length = size - 1;
+    memcpy(buffer, in->data + in->start, length);
+    buffer[strcspn(buffer, "\r\n")] = 0;
+    in->start += consumed;
+    return consumed;
+}
+
+// read exactly count bytes; returns count, or <= 0 on disconnect
+int read_client_bytes(int sock, void *dest, int count)
+{
+    ClientBuffer *in = buffer_for(sock);
+    if (in == NULL || count > CLIENT_BUFFER_SIZE)
+        return -1;
+
+    while (in->end - in->start < count)
+    {
+        int bytes_read = fill_client_buffer(sock, in);
+        if (bytes_read <= 0)
+            return bytes_read;
+    }
+    memcpy(dest, in->data + in->start, count);
+    in->start += count;
+    return count;
+}
+
+// Returns the next byte without consuming it, or -1 on disconnect
+int peek_client_byte(int sock)
+{
+    ClientBuffer *in = buffer_for(sock);
+    if (in == NULL)
+        return -1;
+    if (in->end == in->start && fill_client_buffer(sock, in) <= 0)
+        return -1;
+    return (unsigned char)in->data[in->start];
+}
+
+// Bytes received but not yet consumed
+int client_buffered(int sock)
+{
+    ClientBuffer *in = buffer_for(sock);
+    return in ? in->end - in->start : 0;
+}
+
+// Whether a complete line has arrived, so reading it will not block. Picks up
+// anything already queued on the socket without waiting for more.
+int client_line_ready(int sock)
+{
+    ClientBuffer *in = buffer_for(sock);
+    if (in == NULL)
+        return 0;
+    if (memchr(in->data + in->start, '\n', in->end - in->start) != NULL)
+        return 1;
+
+    compact_client_buffer(in);
+    ssize_t bytes_read = recv(sock, in->data + in->end, CLIENT_BUFFER_SIZE - in->end, MSG_DONTWAIT);
+    if (bytes_read <= 0)
+        return 0;
+    in->end += bytes_read;
+    return memchr(in->data, '\n', in->end) != NULL;
+}
+
+// write len bytes to the client
+void write_client_bytes(int sock, const void *data, size_t len)
+{
+    const char *next = data;
+    while (len > 0)
+    {
+        ssize_t written = write(sock, next, len);
+        if (written < 0)
+        {
+            if (errno == EAGAIN)
+                wait_for_socket(sock, 1);
+            else if (errno != EINTR)
+                return;
+            continue;
+        }
+        next += written;
+        len -= written;
+    }
+}
+
 // write the data to client
 void write_to_client(int sock, const char *message)
 {
-    write(sock, message, strlen(message));
+    write_client_bytes(sock, message, strlen(message));
+}
+
+void outbuf_init(OutBuf *out, int sock)
+{
+    out->sock = sock;
+    out->len = 0;
+}
+
+void outbuf_flush(OutBuf *out)
+{
+    if (out->len > 0)
+        write_client_bytes(out->sock, out->data, out->len);
+    out->len = 0;
+}
+
+// Appends formatted text, sending the buffer first if the text does not fit
+void outbuf_printf(OutBuf *out, const char *format, ...)
+{
+    va_list args;
+    va_start(args, format);
+    int needed = vsnprintf(out->data + out->len, OUTBUF_SIZE - out->len, format, args);
+    va_end(args);
+    if (needed < 0 || out->len + needed < OUTBUF_SIZE)
+    {
+        if (needed > 0)
+            out->len += needed;
+        return;
+    }
+
+    outbuf_flush(out);
+    va_start(args, format);
+    if (needed < OUTBUF_SIZE)
+    {
+        vsnprintf(out->data, OUTBUF_SIZE, format, args);
+        out->len = needed;
+    }
+    else
+    {
+        char *text = malloc(needed + 1);
+        vsnprintf(text, needed + 1, format, args);
+        write_client_bytes(out->sock, text, needed);
+        free(text);
+    }
+    va_end(args);
 }